@@ -0,0 +1,98 @@
+#include "bit_packing.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define BIT_PACKING_SSE2
+#endif
+
+using namespace std;
+
+uint8_t RequiredBits(uint32_t max_value)
+{
+    uint8_t bits = 0;
+    while (max_value > 0)
+    {
+        ++bits;
+        max_value >>= 1;
+    }
+    return bits;
+}
+
+size_t PackedWordCount(size_t value_count, uint8_t bits)
+{
+    return (value_count * bits + 63) / 64;
+}
+
+void PackBits(const uint32_t* values, size_t value_count, uint8_t bits, vector<uint64_t>& out)
+{
+    const size_t first_word = out.size();
+    out.resize(first_word + PackedWordCount(value_count, bits), 0);
+    if (bits == 0)
+    {
+        return;
+    }
+    for (size_t i = 0; i < value_count; ++i)
+    {
+        const size_t bit_pos = i * bits;
+        const size_t word = first_word + bit_pos / 64;
+        const size_t shift = bit_pos % 64;
+        out[word] |= static_cast<uint64_t>(values[i]) << shift;
+        if (shift + bits > 64)
+        {
+            out[word + 1] |= static_cast<uint64_t>(values[i]) >> (64 - shift);
+        }
+    }
+}
+
+void UnpackBits(const uint64_t* words, size_t value_count, uint8_t bits, uint32_t* values)
+{
+    if (bits == 0)
+    {
+        for (size_t i = 0; i < value_count; ++i)
+        {
+            values[i] = 0;
+        }
+        return;
+    }
+
+    const uint64_t mask = (uint64_t(1) << bits) - 1;
+    for (size_t i = 0; i < value_count; ++i)
+    {
+        const size_t bit_pos = i * bits;
+        const size_t word = bit_pos / 64;
+        const size_t shift = bit_pos % 64;
+        uint64_t value = words[word] >> shift;
+        if (shift + bits > 64)
+        {
+            value |= words[word + 1] << (64 - shift);
+        }
+        values[i] = static_cast<uint32_t>(value & mask);
+    }
+}
+
+void PrefixSum(uint32_t first_value, uint32_t* values, size_t value_count)
+{
+    size_t i = 0;
+#if defined(BIT_PACKING_SSE2)
+    // four sums at a time: two shifted adds give the sums inside a vector, the broadcast last one carries on
+    __m128i carry = _mm_set1_epi32(static_cast<int>(first_value));
+    for (; i + 4 <= value_count; i += 4)
+    {
+        __m128i sums = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        sums = _mm_add_epi32(sums, _mm_slli_si128(sums, 4));
+        sums = _mm_add_epi32(sums, _mm_slli_si128(sums, 8));
+        sums = _mm_add_epi32(sums, carry);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), sums);
+        carry = _mm_shuffle_epi32(sums, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    if (i > 0)
+    {
+        first_value = values[i - 1];
+    }
+#endif
+    for (; i < value_count; ++i)
+    {
+        first_value += values[i];
+        values[i] = first_value;
+    }
+}
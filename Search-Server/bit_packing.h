@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+uint8_t RequiredBits(uint32_t max_value);
+
+size_t PackedWordCount(size_t value_count, uint8_t bits);
+
+// Appends value_count values of the given width to out, starting a new 64-bit word
+void PackBits(const uint32_t* values, size_t value_count, uint8_t bits, std::vector<uint64_t>& out);
+
+void UnpackBits(const uint64_t* words, size_t value_count, uint8_t bits, uint32_t* values);
+
+// values[i] becomes first_value + values[0] + ... + values[i], turning deltas back into the values
+void PrefixSum(uint32_t first_value, uint32_t* values, size_t value_count);
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+struct CacheStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+};
+
+// LRU cache split into shards with a mutex each, so that threads looking up different keys rarely wait for each other.
+// The capacity is shared out between the shards, a small one uses fewer shards, and the cache never holds more
+// entries than the capacity. Each shard evicts its own least recently used entry. Every entry remembers the generation it was computed in, Invalidate() starts a new generation and makes all
+// older entries misses without touching them. A capacity of 0 turns the cache off
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class ConcurrentLruCache
+{
+public:
+    explicit ConcurrentLruCache(size_t capacity = 0, size_t shard_count = 16)
+        : shards_(shard_count)
+    {
+        SetCapacity(capacity);
+    }
+
+    // a copy starts empty, with the same capacity
+    ConcurrentLruCache(const ConcurrentLruCache& other)
+        : ConcurrentLruCache(other.capacity_, other.shards_.size())
+    {
+    }
+
+    // drops every entry, must not run concurrently with other calls
+    void SetCapacity(size_t capacity)
+    {
+        capacity_ = capacity;
+        used_shard_count_ = std::max<size_t>(std::min(capacity, shards_.size()), 1);
+        for (size_t i = 0; i < shards_.size(); ++i)
+        {
+            Shard& shard = shards_[i];
+            shard.capacity = i < used_shard_count_
+                ? capacity / used_shard_count_ + (i < capacity % used_shard_count_ ? 1 : 0) : 0;
+            shard.entries.clear();
+            shard.positions.clear();
+        }
+    }
+
+    size_t GetCapacity() const
+    {
+        return capacity_;
+    }
+
+    uint64_t GetGeneration() const
+    {
+        return generation_.load();
+    }
+
+    void Invalidate()
+    {
+        ++generation_;
+    }
+
+    std::optional<Value> Find(const Key& key)
+    {
+        Shard& shard = GetShard(key);
+        std::lock_guard guard(shard.mutex);
+        const auto position = shard.positions.find(key);
+        if (position == shard.positions.end() || position->second->generation != generation_.load())
+        {
+            if (position != shard.positions.end())
+            {
+                shard.entries.erase(position->second);
+                shard.positions.erase(position);
+            }
+            ++misses_;
+            return std::nullopt;
+        }
+        shard.entries.splice(shard.entries.begin(), shard.entries, position->second);
+        ++hits_;
+        return position->second->value;
+    }
+
+    // generation is the one read before value was computed, a value computed across Invalidate() is not kept
+    void Insert(const Key& key, Value value, uint64_t generation)
+    {
+        if (capacity_ == 0 || generation != generation_.load())
+        {
+            return;
+        }
+        Shard& shard = GetShard(key);
+        std::lock_guard guard(shard.mutex);
+        const auto position = shard.positions.find(key);
+        if (position != shard.positions.end())
+        {
+            position->second->value = std::move(value);
+            position->second->generation = generation;
+            shard.entries.splice(shard.entries.begin(), shard.entries, position->second);
+            return;
+        }
+        shard.entries.push_front({ key, std::move(value), generation });
+        shard.positions.emplace(key, shard.entries.begin());
+        if (shard.entries.size() > shard.capacity)
+        {
+            shard.positions.erase(shard.entries.back().key);
+            shard.entries.pop_back();
+            ++evictions_;
+        }
+    }
+
+    // entries of every generation, stale ones go once they are looked up or evicted
+    size_t GetSize()
+    {
+        size_t size = 0;
+        for (size_t i = 0; i < used_shard_count_; ++i)
+        {
+            std::lock_guard guard(shards_[i].mutex);
+            size += shards_[i].entries.size();
+        }
+        return size;
+    }
+
+    CacheStats GetStats() const
+    {
+        return { hits_.load(), misses_.load(), evictions_.load() };
+    }
+
+private:
+    struct Entry
+    {
+        Key key;
+        Value value;
+        uint64_t generation;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        size_t capacity = 0;
+        // most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> positions;
+    };
+
+    Shard& GetShard(const Key& key)
+    {
+        return shards_[Hash{}(key) % used_shard_count_];
+    }
+
+    std::vector<Shard> shards_;
+    size_t capacity_ = 0;
+    size_t used_shard_count_ = 1;
+    std::atomic<uint64_t> generation_ = 0;
+    std::atomic<uint64_t> hits_ = 0;
+    std::atomic<uint64_t> misses_ = 0;
+    std::atomic<uint64_t> evictions_ = 0;
+};
@@ -0,0 +1,144 @@
+#include "log_duration.h"
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Times TermDictionary::FindWithinDistance, which walks the sorted terms as a trie, against computing
+// the edit distance to every term of a dictionary of several million terms
+namespace
+{
+    const size_t TERM_COUNT = 3000000;
+    const size_t QUERY_COUNT = 20;
+
+    string GenerateTerm(mt19937& generator)
+    {
+        uniform_int_distribution<size_t> length_distribution(4, 12);
+        uniform_int_distribution<int> letter_distribution('a', 'z');
+        string term(length_distribution(generator), ' ');
+        for (char& c : term) {
+            c = static_cast<char>(letter_distribution(generator));
+        }
+        return term;
+    }
+
+    // a term of the dictionary with one or two random substitutions, insertions or deletions
+    string GenerateMisspelling(const TermDictionary& dictionary, mt19937& generator)
+    {
+        string term(dictionary.GetTerm(static_cast<TermId>(generator() % dictionary.size())));
+        const size_t edit_count = 1 + generator() % 2;
+        for (size_t i = 0; i < edit_count; ++i) {
+            const size_t position = generator() % term.size();
+            const char letter = static_cast<char>('a' + generator() % 26);
+            switch (generator() % 3) {
+            case 0:
+                term[position] = letter;
+                break;
+            case 1:
+                term.insert(term.begin() + position, letter);
+                break;
+            default:
+                term.erase(position, 1);
+            }
+        }
+        return term;
+    }
+
+    // the edit distance of lhs and rhs, or max_distance + 1 once it is known to be larger
+    uint32_t ComputeEditDistance(string_view lhs, string_view rhs, uint32_t max_distance, vector<uint32_t>& rows)
+    {
+        const uint32_t length_difference = static_cast<uint32_t>(
+            lhs.size() > rhs.size() ? lhs.size() - rhs.size() : rhs.size() - lhs.size());
+        if (length_difference > max_distance) {
+            return max_distance + 1;
+        }
+        const size_t width = rhs.size() + 1;
+        rows.resize(width * 2);
+        uint32_t* previous = rows.data();
+        uint32_t* current = rows.data() + width;
+        for (size_t j = 0; j < width; ++j) {
+            previous[j] = static_cast<uint32_t>(j);
+        }
+        for (size_t i = 1; i <= lhs.size(); ++i) {
+            current[0] = static_cast<uint32_t>(i);
+            uint32_t row_min = current[0];
+            for (size_t j = 1; j < width; ++j) {
+                current[j] = min({ previous[j] + 1, current[j - 1] + 1,
+                    previous[j - 1] + (lhs[i - 1] == rhs[j - 1] ? 0u : 1u) });
+                row_min = min(row_min, current[j]);
+            }
+            if (row_min > max_distance) {
+                return max_distance + 1;
+            }
+            swap(previous, current);
+        }
+        return previous[rhs.size()];
+    }
+
+    vector<pair<TermId, uint32_t>> FindWithinDistanceLinear(const TermDictionary& dictionary, string_view term,
+        uint32_t max_distance)
+    {
+        vector<pair<TermId, uint32_t>> matches;
+        vector<uint32_t> rows;
+        for (TermId term_id = 0; term_id < dictionary.size(); ++term_id) {
+            const uint32_t distance = ComputeEditDistance(dictionary.GetTerm(term_id), term, max_distance, rows);
+            if (distance <= max_distance) {
+                matches.push_back({ term_id, distance });
+            }
+        }
+        return matches;
+    }
+}
+
+int main()
+{
+    mt19937 generator(42);
+    TermDictionary dictionary;
+    {
+        LOG_DURATION("insert "s + to_string(TERM_COUNT) + " terms"s);
+        while (dictionary.size() < TERM_COUNT) {
+            dictionary.Insert(GenerateTerm(generator));
+        }
+    }
+
+    vector<string> queries;
+    for (size_t i = 0; i < QUERY_COUNT; ++i) {
+        queries.push_back(GenerateMisspelling(dictionary, generator));
+    }
+
+    for (const uint32_t max_distance : { 1u, 2u }) {
+        vector<vector<pair<TermId, uint32_t>>> trie_matches;
+        {
+            LOG_DURATION("trie walk, distance "s + to_string(max_distance));
+            for (const string& query : queries) {
+                trie_matches.push_back(dictionary.FindWithinDistance(query, max_distance));
+            }
+        }
+        vector<vector<pair<TermId, uint32_t>>> linear_matches;
+        {
+            LOG_DURATION("linear scan, distance "s + to_string(max_distance));
+            for (const string& query : queries) {
+                linear_matches.push_back(FindWithinDistanceLinear(dictionary, query, max_distance));
+            }
+        }
+
+        size_t match_count = 0;
+        for (size_t i = 0; i < queries.size(); ++i) {
+            sort(trie_matches[i].begin(), trie_matches[i].end());
+            if (trie_matches[i] != linear_matches[i]) {
+                cout << "results differ for "s << queries[i] << endl;
+                return 1;
+            }
+            match_count += trie_matches[i].size();
+        }
+        cout << "distance "s << max_distance << ": "s << match_count << " matches for "s << queries.size()
+            << " queries"s << endl;
+    }
+}
@@ -0,0 +1,181 @@
+#include "index_segment.h"
+
+using namespace std;
+
+IndexSegment::IndexSegment(DocumentOrdinal first_ordinal)
+    : first_ordinal_(first_ordinal)
+    , last_ordinal_(first_ordinal)
+{
+}
+
+IndexSegment IndexSegment::Merge(const vector<const IndexSegment*>& segments, const vector<bool>& is_deleted,
+    PostingEncoding encoding, const vector<uint32_t>& document_lengths)
+{
+    IndexSegment merged(segments.front()->first_ordinal_);
+    merged.last_ordinal_ = segments.back()->last_ordinal_;
+    merged.document_count_ = is_deleted.size() - count(is_deleted.begin(), is_deleted.end(), true);
+    size_t word_count = 0;
+    for (const IndexSegment* segment : segments)
+    {
+        word_count = max(word_count, segment->word_to_postings_.size());
+    }
+
+    for (TermId word = 0; word < word_count; ++word)
+    {
+        PostingList postings;
+        for (const IndexSegment* segment : segments)
+        {
+            for (PostingCursor cursor(segment->GetPostings(word), segment->first_ordinal_, segment->last_ordinal_);
+                !cursor.AtEnd(); cursor.Next())
+            {
+                if (!is_deleted[cursor.Ordinal() - merged.first_ordinal_])
+                {
+                    postings.Add(cursor.Ordinal(), cursor.TermFreq());
+                }
+            }
+        }
+        if (!postings.empty())
+        {
+            merged.GetOrAddPostings(word) = std::move(postings);
+        }
+    }
+    merged.Compact(encoding, document_lengths, merged.first_ordinal_);
+    return merged;
+}
+
+IndexSegment IndexSegment::Open(SnapshotReader& reader)
+{
+    IndexSegment segment(reader.ReadValue<DocumentOrdinal>());
+    segment.last_ordinal_ = reader.ReadValue<DocumentOrdinal>();
+    segment.document_count_ = reader.ReadValue<uint64_t>();
+    segment.word_to_postings_ = reader.ReadArray<uint32_t>();
+    segment.postings_ = PostingList::Open(reader);
+    segment.document_lengths_ = reader.ReadArray<uint32_t>();
+    const bool has_broken_word = any_of(segment.word_to_postings_.begin(), segment.word_to_postings_.end(),
+        [&segment](uint32_t postings) {
+            return postings != NO_POSTINGS && postings >= segment.postings_.size();
+        });
+    const bool has_compressed_postings = any_of(segment.postings_.begin(), segment.postings_.end(),
+        [](const PostingList& postings) {
+            return postings.IsCompressed();
+        });
+    if (segment.last_ordinal_ < segment.first_ordinal_
+        || segment.document_count_ > segment.last_ordinal_ - segment.first_ordinal_ || has_broken_word
+        || (has_compressed_postings
+            && segment.document_lengths_.size() != segment.last_ordinal_ - segment.first_ordinal_)) {
+        throw invalid_argument("Snapshot has a broken index segment"s);
+    }
+    segment.SetDocumentLengths();
+    return segment;
+}
+
+void IndexSegment::Save(SnapshotWriter& writer) const
+{
+    writer.WriteValue(first_ordinal_);
+    writer.WriteValue(last_ordinal_);
+    writer.WriteValue(static_cast<uint64_t>(document_count_));
+    writer.WriteArray(word_to_postings_.data(), word_to_postings_.size());
+    PostingList::Save(postings_, writer);
+    writer.WriteArray(document_lengths_.data(), document_lengths_.size());
+}
+
+void IndexSegment::AddDocument(DocumentOrdinal ordinal, TermFrequencies word_freqs)
+{
+    for (const auto& [word, term_freq] : word_freqs)
+    {
+        GetOrAddPostings(word).Add(ordinal, term_freq);
+    }
+    last_ordinal_ = ordinal + 1;
+    ++document_count_;
+}
+
+void IndexSegment::Append(const PartialIndex& index)
+{
+    for (size_t i = 0; i < index.words.size(); ++i)
+    {
+        PostingList& postings = GetOrAddPostings(index.words[i]);
+        for (size_t posting = index.offsets[i]; posting < index.offsets[i + 1]; ++posting)
+        {
+            postings.Add(index.ordinals[posting], index.term_freqs[posting]);
+        }
+    }
+    last_ordinal_ = index.last_ordinal;
+    document_count_ += index.last_ordinal - index.first_ordinal;
+}
+
+void IndexSegment::Compact(PostingEncoding encoding, const vector<uint32_t>& document_lengths, DocumentOrdinal first_ordinal)
+{
+    if (encoding == PostingEncoding::COMPRESSED && document_lengths_.empty())
+    {
+        document_lengths_.Mutable().assign(document_lengths.begin() + (first_ordinal_ - first_ordinal),
+            document_lengths.begin() + (last_ordinal_ - first_ordinal));
+    }
+    for (PostingList& postings : postings_)
+    {
+        postings.Compact();
+        if (encoding == PostingEncoding::COMPRESSED)
+        {
+            postings.Compress(document_lengths_.data(), first_ordinal_);
+        }
+    }
+}
+
+const PostingList& IndexSegment::GetPostings(TermId word) const
+{
+    static const PostingList empty_postings;
+    if (word >= word_to_postings_.size() || word_to_postings_[word] == NO_POSTINGS)
+    {
+        return empty_postings;
+    }
+    return postings_[word_to_postings_[word]];
+}
+
+DocumentOrdinal IndexSegment::GetFirstOrdinal() const
+{
+    return first_ordinal_;
+}
+
+DocumentOrdinal IndexSegment::GetLastOrdinal() const
+{
+    return last_ordinal_;
+}
+
+size_t IndexSegment::GetDocumentCount() const
+{
+    return document_count_;
+}
+
+size_t IndexSegment::GetMemoryUsage() const
+{
+    size_t memory_usage = word_to_postings_.GetMemoryUsage() + document_lengths_.GetMemoryUsage();
+    for (const PostingList& postings : postings_)
+    {
+        memory_usage += postings.GetMemoryUsage();
+    }
+    return memory_usage;
+}
+
+PostingList& IndexSegment::GetOrAddPostings(TermId word)
+{
+    if (word >= word_to_postings_.size())
+    {
+        word_to_postings_.Mutable().resize(word + 1, NO_POSTINGS);
+    }
+    if (word_to_postings_[word] == NO_POSTINGS)
+    {
+        word_to_postings_.Mutable()[word] = static_cast<uint32_t>(postings_.size());
+        postings_.emplace_back();
+    }
+    return postings_[word_to_postings_[word]];
+}
+
+void IndexSegment::SetDocumentLengths()
+{
+    for (PostingList& postings : postings_)
+    {
+        if (postings.IsCompressed())
+        {
+            postings.SetDocumentLengths(document_lengths_.data(), first_ordinal_);
+        }
+    }
+}
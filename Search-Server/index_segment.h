@@ -0,0 +1,82 @@
+#pragma once
+
+#include "posting_list.h"
+#include "snapshot.h"
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Inverted index of the consecutive documents [first_ordinal, last_ordinal) built apart from any segment.
+// The postings of words[i] are ordinals[offsets[i], offsets[i + 1]) and term_freqs at the same positions
+struct PartialIndex
+{
+    DocumentOrdinal first_ordinal = 0;
+    DocumentOrdinal last_ordinal = 0;
+    std::vector<TermId> words;
+    std::vector<size_t> offsets;
+    std::vector<DocumentOrdinal> ordinals;
+    std::vector<double> term_freqs;
+};
+
+// Postings of the documents with ordinals in [first_ordinal, last_ordinal), one list per term present in them.
+// The newest segment of a server takes new documents, the older ones are frozen and never modified again
+class IndexSegment
+{
+public:
+    explicit IndexSegment(DocumentOrdinal first_ordinal = 0);
+
+    // compressed lists refer to document_lengths_, which keeps its storage when moved but not when copied
+    IndexSegment(const IndexSegment&) = delete;
+
+    IndexSegment(IndexSegment&&) = default;
+
+    IndexSegment& operator=(const IndexSegment&) = delete;
+
+    IndexSegment& operator=(IndexSegment&&) = default;
+
+    // one segment with the postings of consecutive segments, leaving out the ordinals marked in is_deleted.
+    // is_deleted[i] and document_lengths[i] describe the document segments.front()->GetFirstOrdinal() + i
+    static IndexSegment Merge(const std::vector<const IndexSegment*>& segments, const std::vector<bool>& is_deleted,
+        PostingEncoding encoding, const std::vector<uint32_t>& document_lengths);
+
+    static IndexSegment Open(SnapshotReader& reader);
+
+    void Save(SnapshotWriter& writer) const;
+
+    void AddDocument(DocumentOrdinal ordinal, TermFrequencies word_freqs);
+
+    // the documents of index have to follow the last document of the segment
+    void Append(const PartialIndex& index);
+
+    // document_lengths[i] is the length of the document first_ordinal + i
+    void Compact(PostingEncoding encoding, const std::vector<uint32_t>& document_lengths, DocumentOrdinal first_ordinal);
+
+    const PostingList& GetPostings(TermId word) const;
+
+    DocumentOrdinal GetFirstOrdinal() const;
+
+    DocumentOrdinal GetLastOrdinal() const;
+
+    size_t GetDocumentCount() const;
+
+    size_t GetMemoryUsage() const;
+
+private:
+    static constexpr uint32_t NO_POSTINGS = std::numeric_limits<uint32_t>::max();
+
+    PostingList& GetOrAddPostings(TermId word);
+
+    void SetDocumentLengths();
+
+    DocumentOrdinal first_ordinal_;
+    DocumentOrdinal last_ordinal_;
+    size_t document_count_ = 0;
+    // index in postings_ for every term id, most terms of a large dictionary have no postings in a given segment
+    MappedArray<uint32_t> word_to_postings_;
+    std::vector<PostingList> postings_;
+    // lengths of the documents [first_ordinal_, last_ordinal_), kept while postings are compressed
+    MappedArray<uint32_t> document_lengths_;
+};
@@ -1,5 +1,6 @@
 #include "search_server.h"
 #include "log_duration.h"
+#include "near_duplicates.h"
 #include "process_queries.h"
 #include <execution>
 #include <iostream>
@@ -27,12 +28,15 @@ void FillDB(SearchServer& s)
     s.AddDocument(0, "First document", DocumentStatus::ACTUAL, { 1,3,5 });
     s.AddDocument(1, "Second file in server", DocumentStatus::ACTUAL, {});
     s.AddDocument(2, "Second minus one document", DocumentStatus::ACTUAL, { 1, -2 });
+    // shares 4 of its 5 words with document 2
+    s.AddDocument(3, "Second minus one document copy", DocumentStatus::ACTUAL, { 1, -2 });
 }
 
 int main() {
 
     SearchServer server = ConstructServer();
     FillDB(server);
+    RemoveNearDuplicates(server);
 
     for(const auto& doc : server.FindTopDocuments("document"))
     {
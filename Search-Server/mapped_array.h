@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Read-only array that either owns its elements or refers to memory of an opened snapshot.
+// The first call to Mutable() copies referred elements into owned storage
+template <typename T>
+class MappedArray
+{
+public:
+    MappedArray() = default;
+
+    MappedArray(const T* data, size_t size)
+        : mapped_(data)
+        , mapped_size_(size)
+        , is_mapped_(true)
+    {
+    }
+
+    const T* data() const
+    {
+        return is_mapped_ ? mapped_ : owned_.data();
+    }
+
+    size_t size() const
+    {
+        return is_mapped_ ? mapped_size_ : owned_.size();
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    const T* begin() const
+    {
+        return data();
+    }
+
+    const T* end() const
+    {
+        return data() + size();
+    }
+
+    const T& operator[](size_t index) const
+    {
+        return data()[index];
+    }
+
+    const T& back() const
+    {
+        return data()[size() - 1];
+    }
+
+    bool IsMapped() const
+    {
+        return is_mapped_;
+    }
+
+    // memory held by the array itself, mapped elements belong to the page cache
+    size_t GetMemoryUsage() const
+    {
+        return owned_.capacity() * sizeof(T);
+    }
+
+    std::vector<T>& Mutable()
+    {
+        if (is_mapped_)
+        {
+            owned_.assign(mapped_, mapped_ + mapped_size_);
+            mapped_ = nullptr;
+            mapped_size_ = 0;
+            is_mapped_ = false;
+        }
+        return owned_;
+    }
+
+private:
+    std::vector<T> owned_;
+    const T* mapped_ = nullptr;
+    size_t mapped_size_ = 0;
+    bool is_mapped_ = false;
+};
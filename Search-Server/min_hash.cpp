@@ -0,0 +1,56 @@
+#include "min_hash.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+namespace
+{
+    constexpr uint64_t Mix(uint64_t value)
+    {
+        value += 0x9E3779B97F4A7C15ull;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+        return value ^ (value >> 31);
+    }
+
+    constexpr array<uint64_t, MIN_HASH_COUNT> MakeMultipliers()
+    {
+        array<uint64_t, MIN_HASH_COUNT> multipliers{};
+        for (size_t i = 0; i < MIN_HASH_COUNT; ++i)
+        {
+            multipliers[i] = Mix(i) | 1;
+        }
+        return multipliers;
+    }
+
+    // fixed, so that sketches stay comparable between runs
+    constexpr array<uint64_t, MIN_HASH_COUNT> MULTIPLIERS = MakeMultipliers();
+}
+
+// every word is hashed once, the functions are then multiply-shift hashes of that value
+MinHashSketch ComputeMinHashSketch(TermFrequencies word_freqs)
+{
+    MinHashSketch sketch;
+    sketch.fill(numeric_limits<uint32_t>::max());
+    for (const auto& [word, term_freq] : word_freqs)
+    {
+        const uint64_t hash = Mix(word);
+        for (size_t i = 0; i < MIN_HASH_COUNT; ++i)
+        {
+            sketch[i] = min(sketch[i], static_cast<uint32_t>((hash * MULTIPLIERS[i]) >> 32));
+        }
+    }
+    return sketch;
+}
+
+double EstimateJaccardSimilarity(const MinHashSketch& lhs, const MinHashSketch& rhs)
+{
+    size_t equal_count = 0;
+    for (size_t i = 0; i < MIN_HASH_COUNT; ++i)
+    {
+        equal_count += lhs[i] == rhs[i] ? 1 : 0;
+    }
+    return static_cast<double>(equal_count) / MIN_HASH_COUNT;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "term_dictionary.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+const size_t MIN_HASH_COUNT = 64;
+
+using MinHashSketch = std::array<uint32_t, MIN_HASH_COUNT>;
+
+// Minimum of each of MIN_HASH_COUNT hash functions over the words of a document. Sketches of two documents
+// agree in a position with probability equal to the Jaccard similarity of their word sets
+MinHashSketch ComputeMinHashSketch(TermFrequencies word_freqs);
+
+// the share of positions where the sketches agree, an unbiased estimate of the Jaccard similarity
+// with a standard error of at most 0.5 / sqrt(MIN_HASH_COUNT)
+double EstimateJaccardSimilarity(const MinHashSketch& lhs, const MinHashSketch& rhs);
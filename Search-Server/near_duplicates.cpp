@@ -0,0 +1,176 @@
+#include "near_duplicates.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <execution>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    // the S-curve of the bands is placed this far below the requested similarity, so that few pairs above it are missed
+    const double LSH_THRESHOLD_MARGIN = 0.1;
+    // four standard errors of a sketch estimate, a pair above the requested similarity is almost never filtered out
+    const double SKETCH_FILTER_MARGIN = 0.2;
+    // Documents a document is compared with in one bucket of a band. A larger bucket comes from frequent words
+    // shared by unrelated documents, near duplicates in it also meet in the smaller buckets of other bands
+    const size_t MAX_BUCKET_PARTNERS = 16;
+
+    struct Candidate
+    {
+        size_t document;
+        size_t original;
+        double similarity;
+    };
+
+    // MIN_HASH_COUNT / rows bands of rows hashes each let a pair of similarity s share a band with probability
+    // 1 - (1 - s^rows)^bands, which rises steeply around (1 / bands)^(1 / rows)
+    size_t ChooseBandRows(double min_similarity)
+    {
+        size_t rows = 1;
+        while (rows * 2 <= MIN_HASH_COUNT
+            && pow(rows * 2.0 / MIN_HASH_COUNT, 1.0 / (rows * 2)) <= min_similarity - LSH_THRESHOLD_MARGIN)
+        {
+            rows *= 2;
+        }
+        return rows;
+    }
+
+    uint64_t HashBand(const MinHashSketch& sketch, size_t first, size_t rows)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = first; i < first + rows; ++i)
+        {
+            hash = (hash ^ sketch[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    double ComputeJaccardSimilarity(TermFrequencies lhs, TermFrequencies rhs)
+    {
+        if (lhs.empty() && rhs.empty())
+        {
+            return 1.0;
+        }
+        size_t common_count = 0;
+        for (auto left = lhs.begin(), right = rhs.begin(); left != lhs.end() && right != rhs.end();)
+        {
+            if (left->first < right->first)
+            {
+                ++left;
+            }
+            else if (right->first < left->first)
+            {
+                ++right;
+            }
+            else
+            {
+                ++common_count;
+                ++left;
+                ++right;
+            }
+        }
+        return static_cast<double>(common_count) / (lhs.size() + rhs.size() - common_count);
+    }
+}
+
+vector<NearDuplicate> FindNearDuplicates(const SearchServer& search_server, double min_similarity)
+{
+    if (!(min_similarity > 0.0 && min_similarity <= 1.0)) {
+        throw invalid_argument("Similarity threshold must be in (0, 1]"s);
+    }
+
+    const vector<int> document_ids(search_server.begin(), search_server.end());
+    vector<MinHashSketch> sketches(document_ids.size());
+    transform(execution::par, document_ids.begin(), document_ids.end(), sketches.begin(), [&](int document_id)
+        {
+            return search_server.HasMinHashSketches() ? search_server.GetMinHashSketch(document_id)
+                : ComputeMinHashSketch(search_server.GetTermFrequencies(document_id));
+        });
+
+    // every band groups the documents by the hash of its rows, inside a group each document is paired with
+    // a few documents before it whose sketches agree well enough. Documents are numbered in the order of their ids
+    const size_t rows = ChooseBandRows(min_similarity);
+    const double min_estimate = min_similarity - SKETCH_FILTER_MARGIN;
+    vector<vector<Candidate>> band_candidates(MIN_HASH_COUNT / rows);
+    vector<size_t> bands(band_candidates.size());
+    iota(bands.begin(), bands.end(), 0);
+    for_each(execution::par, bands.begin(), bands.end(), [&](size_t band)
+        {
+            vector<pair<uint64_t, size_t>> buckets(document_ids.size());
+            for (size_t document = 0; document < document_ids.size(); ++document)
+            {
+                buckets[document] = { HashBand(sketches[document], band * rows, rows), document };
+            }
+            sort(buckets.begin(), buckets.end());
+
+            for (size_t start = 0, end = 0; start < buckets.size(); start = end)
+            {
+                while (end < buckets.size() && buckets[end].first == buckets[start].first)
+                {
+                    ++end;
+                }
+                for (size_t i = start + 1; i < end; ++i)
+                {
+                    const size_t document = buckets[i].second;
+                    const size_t first_partner = i - min(i - start, MAX_BUCKET_PARTNERS);
+                    for (size_t j = first_partner; j < i; ++j)
+                    {
+                        const size_t original = buckets[j].second;
+                        if (EstimateJaccardSimilarity(sketches[document], sketches[original]) >= min_estimate)
+                        {
+                            band_candidates[band].push_back({ document, original, 0.0 });
+                        }
+                    }
+                }
+            }
+        });
+
+    // a pair found by several bands is verified once, on the exact word sets
+    vector<Candidate> candidates;
+    for (const vector<Candidate>& band : band_candidates)
+    {
+        candidates.insert(candidates.end(), band.begin(), band.end());
+    }
+    const auto is_less = [](const Candidate& lhs, const Candidate& rhs) {
+        return lhs.document < rhs.document || (lhs.document == rhs.document && lhs.original < rhs.original);
+    };
+    sort(execution::par, candidates.begin(), candidates.end(), is_less);
+    candidates.erase(unique(candidates.begin(), candidates.end(), [](const Candidate& lhs, const Candidate& rhs) {
+        return lhs.document == rhs.document && lhs.original == rhs.original;
+    }), candidates.end());
+    for_each(execution::par, candidates.begin(), candidates.end(), [&](Candidate& candidate)
+        {
+            candidate.similarity = ComputeJaccardSimilarity(search_server.GetTermFrequencies(document_ids[candidate.document]),
+                search_server.GetTermFrequencies(document_ids[candidate.original]));
+        });
+
+    // a document is a near duplicate only of an original that is kept itself
+    vector<bool> is_removed(document_ids.size());
+    vector<NearDuplicate> near_duplicates;
+    for (const Candidate& candidate : candidates)
+    {
+        if (candidate.similarity >= min_similarity && !is_removed[candidate.document] && !is_removed[candidate.original])
+        {
+            is_removed[candidate.document] = true;
+            near_duplicates.push_back({ document_ids[candidate.document], document_ids[candidate.original],
+                candidate.similarity });
+        }
+    }
+    return near_duplicates;
+}
+
+void RemoveNearDuplicates(SearchServer& search_server, double min_similarity)
+{
+    vector<int> documents_to_remove;
+    for (const NearDuplicate& near_duplicate : FindNearDuplicates(search_server, min_similarity)) {
+        cout << "Found near duplicate document id " << near_duplicate.document_id
+            << " of document id " << near_duplicate.original_id << "\n";
+        documents_to_remove.push_back(near_duplicate.document_id);
+    }
+    search_server.RemoveDocuments(documents_to_remove);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <vector>
+
+const double NEAR_DUPLICATE_SIMILARITY = 0.8;
+
+struct NearDuplicate
+{
+    int document_id;
+    int original_id;
+    double similarity;
+};
+
+// Documents whose word sets have a Jaccard similarity of at least min_similarity with a kept document of a smaller id,
+// sorted by id. Candidate pairs come from LSH bands over the MinHash sketches and are checked on the exact word sets:
+// nothing below min_similarity is reported, while a pair above it is missed with a small probability
+std::vector<NearDuplicate> FindNearDuplicates(const SearchServer& search_server,
+    double min_similarity = NEAR_DUPLICATE_SIMILARITY);
+
+void RemoveNearDuplicates(SearchServer& search_server, double min_similarity = NEAR_DUPLICATE_SIMILARITY);
@@ -0,0 +1,196 @@
+#include "ordinal_bitmap.h"
+
+#include <algorithm>
+#include <bitset>
+#include <iterator>
+
+using namespace std;
+
+void OrdinalBitmap::Add(DocumentOrdinal ordinal)
+{
+    const size_t chunk_index = ordinal >> CHUNK_BITS;
+    if (chunk_index >= chunks_.size())
+    {
+        chunks_.resize(chunk_index + 1);
+    }
+    Chunk& chunk = chunks_[chunk_index];
+    const uint16_t low_bits = static_cast<uint16_t>(ordinal);
+    if (!chunk.words.empty())
+    {
+        uint64_t& word = chunk.words[low_bits / 64];
+        const uint64_t bit = uint64_t(1) << (low_bits % 64);
+        if ((word & bit) == 0)
+        {
+            word |= bit;
+            ++chunk.count;
+            ++size_;
+        }
+        return;
+    }
+
+    // ordinals mostly come in increasing order
+    if (chunk.values.empty() || chunk.values.back() < low_bits)
+    {
+        chunk.values.push_back(low_bits);
+    }
+    else
+    {
+        const auto position = lower_bound(chunk.values.begin(), chunk.values.end(), low_bits);
+        if (*position == low_bits)
+        {
+            return;
+        }
+        chunk.values.insert(position, low_bits);
+    }
+    ++chunk.count;
+    ++size_;
+
+    if (chunk.count > MAX_ARRAY_SIZE)
+    {
+        ConvertToBitmap(chunk);
+    }
+}
+
+void OrdinalBitmap::Remove(DocumentOrdinal ordinal)
+{
+    const size_t chunk_index = ordinal >> CHUNK_BITS;
+    if (chunk_index >= chunks_.size())
+    {
+        return;
+    }
+    Chunk& chunk = chunks_[chunk_index];
+    const uint16_t low_bits = static_cast<uint16_t>(ordinal);
+    if (chunk.words.empty())
+    {
+        const auto position = lower_bound(chunk.values.begin(), chunk.values.end(), low_bits);
+        if (position != chunk.values.end() && *position == low_bits)
+        {
+            chunk.values.erase(position);
+            --chunk.count;
+            --size_;
+        }
+        return;
+    }
+
+    uint64_t& word = chunk.words[low_bits / 64];
+    const uint64_t bit = uint64_t(1) << (low_bits % 64);
+    if ((word & bit) == 0)
+    {
+        return;
+    }
+    word &= ~bit;
+    --chunk.count;
+    --size_;
+
+    // half the limit, so that a chunk near it does not switch on every change
+    if (chunk.count <= MAX_ARRAY_SIZE / 2)
+    {
+        ConvertToArray(chunk);
+    }
+}
+
+void OrdinalBitmap::UnionWith(const OrdinalBitmap& other)
+{
+    if (chunks_.size() < other.chunks_.size())
+    {
+        chunks_.resize(other.chunks_.size());
+    }
+    for (size_t chunk_index = 0; chunk_index < other.chunks_.size(); ++chunk_index)
+    {
+        Chunk& chunk = chunks_[chunk_index];
+        const Chunk& other_chunk = other.chunks_[chunk_index];
+        if (other_chunk.count == 0)
+        {
+            continue;
+        }
+        size_ -= chunk.count;
+        if (chunk.words.empty() && other_chunk.words.empty())
+        {
+            vector<uint16_t> values;
+            values.reserve(chunk.values.size() + other_chunk.values.size());
+            set_union(chunk.values.begin(), chunk.values.end(), other_chunk.values.begin(), other_chunk.values.end(),
+                back_inserter(values));
+            chunk.values = move(values);
+            chunk.count = chunk.values.size();
+            if (chunk.count > MAX_ARRAY_SIZE)
+            {
+                ConvertToBitmap(chunk);
+            }
+        }
+        else
+        {
+            if (chunk.words.empty())
+            {
+                ConvertToBitmap(chunk);
+            }
+            for (const uint16_t value : other_chunk.values)
+            {
+                chunk.words[value / 64] |= uint64_t(1) << (value % 64);
+            }
+            for (size_t i = 0; i < other_chunk.words.size(); ++i)
+            {
+                chunk.words[i] |= other_chunk.words[i];
+            }
+            chunk.count = 0;
+            for (const uint64_t word : chunk.words)
+            {
+                chunk.count += bitset<64>(word).count();
+            }
+        }
+        size_ += chunk.count;
+    }
+}
+
+void OrdinalBitmap::ConvertToBitmaps()
+{
+    for (Chunk& chunk : chunks_)
+    {
+        if (chunk.words.empty() && chunk.count > 0)
+        {
+            ConvertToBitmap(chunk);
+        }
+    }
+}
+
+size_t OrdinalBitmap::size() const
+{
+    return size_;
+}
+
+size_t OrdinalBitmap::GetMemoryUsage() const
+{
+    size_t memory_usage = chunks_.capacity() * sizeof(Chunk);
+    for (const Chunk& chunk : chunks_)
+    {
+        memory_usage += chunk.values.capacity() * sizeof(uint16_t) + chunk.words.capacity() * sizeof(uint64_t);
+    }
+    return memory_usage;
+}
+
+bool OrdinalBitmap::ContainsInArray(const Chunk& chunk, uint16_t low_bits)
+{
+    return binary_search(chunk.values.begin(), chunk.values.end(), low_bits);
+}
+
+void OrdinalBitmap::ConvertToBitmap(Chunk& chunk)
+{
+    chunk.words.assign((size_t(1) << CHUNK_BITS) / 64, 0);
+    for (const uint16_t value : chunk.values)
+    {
+        chunk.words[value / 64] |= uint64_t(1) << (value % 64);
+    }
+    chunk.values = vector<uint16_t>();
+}
+
+void OrdinalBitmap::ConvertToArray(Chunk& chunk)
+{
+    chunk.values.reserve(chunk.count);
+    for (size_t value = 0; value < (size_t(1) << CHUNK_BITS); ++value)
+    {
+        if ((chunk.words[value / 64] >> (value % 64)) & 1)
+        {
+            chunk.values.push_back(static_cast<uint16_t>(value));
+        }
+    }
+    chunk.words = vector<uint64_t>();
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "posting_list.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Set of document ordinals in the manner of a roaring bitmap: ordinals are split into chunks of 2^16 by their
+// high bits, a chunk with few ordinals keeps their low bits in a sorted array and a fuller one a plain bitmap
+class OrdinalBitmap
+{
+public:
+    void Add(DocumentOrdinal ordinal);
+
+    void Remove(DocumentOrdinal ordinal);
+
+    // chunk by chunk, without visiting the ordinals of bitmap chunks one by one
+    void UnionWith(const OrdinalBitmap& other);
+
+    // keeps every non-empty chunk as a bitmap until the next Remove, for sets probed far more often than changed
+    void ConvertToBitmaps();
+
+    bool Contains(DocumentOrdinal ordinal) const
+    {
+        const size_t chunk_index = ordinal >> CHUNK_BITS;
+        if (chunk_index >= chunks_.size())
+        {
+            return false;
+        }
+        const Chunk& chunk = chunks_[chunk_index];
+        const uint16_t low_bits = static_cast<uint16_t>(ordinal);
+        if (!chunk.words.empty())
+        {
+            return (chunk.words[low_bits / 64] >> (low_bits % 64)) & 1;
+        }
+        return ContainsInArray(chunk, low_bits);
+    }
+
+    // calls callback(ordinal) for every ordinal in increasing order
+    template <typename Callback>
+    void ForEach(Callback callback) const;
+
+    size_t size() const;
+
+    size_t GetMemoryUsage() const;
+
+private:
+    static constexpr size_t CHUNK_BITS = 16;
+    // an array of more low bits would take more than the 8 KB of a bitmap
+    static constexpr size_t MAX_ARRAY_SIZE = 4096;
+
+    struct Chunk
+    {
+        // sorted, empty while words is used
+        std::vector<uint16_t> values;
+        std::vector<uint64_t> words;
+        size_t count = 0;
+    };
+
+    static bool ContainsInArray(const Chunk& chunk, uint16_t low_bits);
+
+    static void ConvertToBitmap(Chunk& chunk);
+
+    static void ConvertToArray(Chunk& chunk);
+
+    std::vector<Chunk> chunks_;
+    size_t size_ = 0;
+};
+
+template <typename Callback>
+void OrdinalBitmap::ForEach(Callback callback) const
+{
+    for (size_t chunk_index = 0; chunk_index < chunks_.size(); ++chunk_index)
+    {
+        const Chunk& chunk = chunks_[chunk_index];
+        const DocumentOrdinal high_bits = static_cast<DocumentOrdinal>(chunk_index << CHUNK_BITS);
+        for (const uint16_t value : chunk.values)
+        {
+            callback(high_bits | value);
+        }
+        for (size_t i = 0; i < chunk.words.size(); ++i)
+        {
+            for (size_t bit = 0; bit < 64 && chunk.words[i] >> bit != 0; ++bit)
+            {
+                if ((chunk.words[i] >> bit) & 1)
+                {
+                    callback(high_bits | static_cast<DocumentOrdinal>(i * 64 + bit));
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,141 @@
+#include "position_index.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+    void WriteVarint(uint32_t value, vector<uint8_t>& bytes)
+    {
+        while (value >= 0x80)
+        {
+            bytes.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        bytes.push_back(static_cast<uint8_t>(value));
+    }
+}
+
+PositionIndex::PositionIndex()
+{
+    list_starts_.Mutable().push_back(0);
+    document_starts_.Mutable().push_back(0);
+}
+
+PositionIndex PositionIndex::Open(SnapshotReader& reader)
+{
+    PositionIndex index;
+    index.bytes_ = reader.ReadArray<uint8_t>();
+    index.list_starts_ = reader.ReadArray<uint64_t>();
+    index.document_starts_ = reader.ReadArray<uint64_t>();
+    if (index.list_starts_.empty() || index.document_starts_.empty()
+        || index.list_starts_.back() != index.bytes_.size()
+        || index.document_starts_.back() + 1 != index.list_starts_.size()
+        || !is_sorted(index.list_starts_.begin(), index.list_starts_.end())
+        || !is_sorted(index.document_starts_.begin(), index.document_starts_.end())) {
+        throw invalid_argument("Snapshot has a broken position index"s);
+    }
+    return index;
+}
+
+void PositionIndex::Save(SnapshotWriter& writer) const
+{
+    writer.WriteArray(bytes_.data(), bytes_.size());
+    writer.WriteArray(list_starts_.data(), list_starts_.size());
+    writer.WriteArray(document_starts_.data(), document_starts_.size());
+}
+
+void PositionIndex::AddDocument(size_t word_count, const vector<pair<uint32_t, uint32_t>>& word_positions)
+{
+    vector<uint8_t>& bytes = bytes_.Mutable();
+    vector<uint64_t>& list_starts = list_starts_.Mutable();
+    list_starts.pop_back();
+    for (size_t i = 0; i < word_positions.size(); ++i)
+    {
+        const auto [word, position] = word_positions[i];
+        const bool is_first = i == 0 || word_positions[i - 1].first != word;
+        if (is_first)
+        {
+            list_starts.push_back(bytes.size());
+        }
+        WriteVarint(is_first ? position : position - word_positions[i - 1].second, bytes);
+    }
+    list_starts.push_back(bytes.size());
+    document_starts_.Mutable().push_back(document_starts_.back() + word_count);
+}
+
+void PositionIndex::Append(const PositionIndex& other)
+{
+    const uint64_t byte_offset = bytes_.size();
+    const uint64_t list_offset = list_starts_.size() - 1;
+    bytes_.Mutable().insert(bytes_.Mutable().end(), other.bytes_.begin(), other.bytes_.end());
+    vector<uint64_t>& list_starts = list_starts_.Mutable();
+    list_starts.pop_back();
+    for (const uint64_t start : other.list_starts_)
+    {
+        list_starts.push_back(start + byte_offset);
+    }
+    vector<uint64_t>& document_starts = document_starts_.Mutable();
+    for (size_t i = 1; i < other.document_starts_.size(); ++i)
+    {
+        document_starts.push_back(other.document_starts_[i] + list_offset);
+    }
+}
+
+void PositionIndex::Compact(const vector<bool>& is_removed)
+{
+    PositionIndex compacted;
+    vector<uint8_t>& bytes = compacted.bytes_.Mutable();
+    vector<uint64_t>& list_starts = compacted.list_starts_.Mutable();
+    vector<uint64_t>& document_starts = compacted.document_starts_.Mutable();
+    list_starts.pop_back();
+    document_starts.pop_back();
+    for (size_t ordinal = 0; ordinal + 1 < document_starts_.size(); ++ordinal)
+    {
+        document_starts.push_back(list_starts.size());
+        if (is_removed[ordinal])
+        {
+            continue;
+        }
+        for (uint64_t list = document_starts_[ordinal]; list < document_starts_[ordinal + 1]; ++list)
+        {
+            list_starts.push_back(bytes.size());
+            bytes.insert(bytes.end(), bytes_.begin() + list_starts_[list], bytes_.begin() + list_starts_[list + 1]);
+        }
+    }
+    list_starts.push_back(bytes.size());
+    document_starts.push_back(list_starts.size() - 1);
+    *this = move(compacted);
+}
+
+void PositionIndex::GetPositions(DocumentOrdinal ordinal, size_t word, vector<uint32_t>& positions) const
+{
+    positions.clear();
+    const uint64_t list = document_starts_[ordinal] + word;
+    uint32_t position = 0;
+    uint32_t value = 0;
+    int shift = 0;
+    for (uint64_t i = list_starts_[list]; i < list_starts_[list + 1]; ++i)
+    {
+        value |= static_cast<uint32_t>(bytes_[i] & 0x7F) << shift;
+        shift += 7;
+        if ((bytes_[i] & 0x80) == 0)
+        {
+            position += value;
+            positions.push_back(position);
+            value = 0;
+            shift = 0;
+        }
+    }
+}
+
+size_t PositionIndex::GetDocumentCount() const
+{
+    return document_starts_.size() - 1;
+}
+
+size_t PositionIndex::GetMemoryUsage() const
+{
+    return bytes_.GetMemoryUsage() + list_starts_.GetMemoryUsage() + document_starts_.GetMemoryUsage();
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "mapped_array.h"
+#include "posting_list.h"
+#include "snapshot.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Positions of the words of every document by ordinal, kept apart from the postings so that only phrase queries
+// read them. Word i of a document is its i-th word in term id order, its positions are stored as varint deltas
+class PositionIndex
+{
+public:
+    PositionIndex();
+
+    static PositionIndex Open(SnapshotReader& reader);
+
+    void Save(SnapshotWriter& writer) const;
+
+    // the next ordinal. word_positions holds (word, position) pairs sorted by word and then by position,
+    // every word in [0, word_count) has at least one
+    void AddDocument(size_t word_count, const std::vector<std::pair<uint32_t, uint32_t>>& word_positions);
+
+    // the documents of other follow the last document of this index
+    void Append(const PositionIndex& other);
+
+    // drops the positions of the ordinals marked in is_removed, their documents keep no words at all
+    void Compact(const std::vector<bool>& is_removed);
+
+    void GetPositions(DocumentOrdinal ordinal, size_t word, std::vector<uint32_t>& positions) const;
+
+    size_t GetDocumentCount() const;
+
+    size_t GetMemoryUsage() const;
+
+private:
+    MappedArray<uint8_t> bytes_;
+    // start of every position list in bytes_, followed by the end of the last one
+    MappedArray<uint64_t> list_starts_;
+    // first position list of every document, followed by the end of the lists of the last one
+    MappedArray<uint64_t> document_starts_;
+};
@@ -0,0 +1,149 @@
+#include "log_duration.h"
+#include "posting_list.h"
+#include "score_accumulator.h"
+#include "scoring_model.h"
+
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Times the posting layout of the original server, a map of document ids per word, against the sorted
+// parallel arrays of PostingList on the same synthetic corpus: building the index, scanning every posting
+// and scoring queries. Word ids stand for the interned words in both layouts
+namespace
+{
+    const int DOCUMENT_COUNT = 200000;
+    const int WORDS_PER_DOCUMENT = 10;
+    const int VOCABULARY_SIZE = 50000;
+    const int QUERY_COUNT = 2000;
+    const int WORDS_PER_QUERY = 3;
+
+    struct TestDocument
+    {
+        vector<int> words;
+    };
+
+    vector<TestDocument> GenerateDocuments(mt19937& generator)
+    {
+        // a skewed distribution, a few words are frequent and most are rare as in real texts
+        geometric_distribution<int> word_distribution(10.0 / VOCABULARY_SIZE);
+        vector<TestDocument> documents(DOCUMENT_COUNT);
+        for (TestDocument& document : documents) {
+            for (int i = 0; i < WORDS_PER_DOCUMENT; ++i) {
+                document.words.push_back(word_distribution(generator) % VOCABULARY_SIZE);
+            }
+        }
+        return documents;
+    }
+
+    vector<vector<int>> GenerateQueries(const vector<TestDocument>& documents, mt19937& generator)
+    {
+        uniform_int_distribution<int> document_distribution(0, DOCUMENT_COUNT - 1);
+        uniform_int_distribution<int> word_distribution(0, WORDS_PER_DOCUMENT - 1);
+        vector<vector<int>> queries(QUERY_COUNT);
+        for (vector<int>& query : queries) {
+            for (int i = 0; i < WORDS_PER_QUERY; ++i) {
+                query.push_back(documents[document_distribution(generator)].words[word_distribution(generator)]);
+            }
+        }
+        return queries;
+    }
+
+    void BenchmarkMapLayout(const vector<TestDocument>& documents, const vector<vector<int>>& queries)
+    {
+        map<int, map<int, double>> word_to_document_freqs;
+        {
+            LOG_DURATION("map layout: build"s);
+            for (int id = 0; id < DOCUMENT_COUNT; ++id) {
+                const double inv_word_count = 1.0 / documents[id].words.size();
+                for (const int word : documents[id].words) {
+                    word_to_document_freqs[word][id] += inv_word_count;
+                }
+            }
+        }
+
+        double checksum = 0.0;
+        {
+            LOG_DURATION("map layout: scan"s);
+            for (const auto& [word, document_freqs] : word_to_document_freqs) {
+                for (const auto [id, term_freq] : document_freqs) {
+                    checksum += term_freq;
+                }
+            }
+        }
+
+        size_t matched_count = 0;
+        {
+            LOG_DURATION("map layout: score queries"s);
+            for (const vector<int>& query : queries) {
+                map<int, double> document_to_relevance;
+                for (const int word : query) {
+                    const map<int, double>& document_freqs = word_to_document_freqs.at(word);
+                    const double inverse_document_freq = TfIdfModel::ComputeInverseDocumentFreq(DOCUMENT_COUNT,
+                        static_cast<uint32_t>(document_freqs.size()));
+                    for (const auto [id, term_freq] : document_freqs) {
+                        document_to_relevance[id] += term_freq * inverse_document_freq;
+                    }
+                }
+                matched_count += document_to_relevance.size();
+            }
+        }
+        cout << "map layout: checksum "s << checksum << ", matched "s << matched_count << endl;
+    }
+
+    void BenchmarkPostingLists(const vector<TestDocument>& documents, const vector<vector<int>>& queries)
+    {
+        vector<PostingList> postings(VOCABULARY_SIZE);
+        {
+            LOG_DURATION("posting lists: build"s);
+            for (int id = 0; id < DOCUMENT_COUNT; ++id) {
+                const double inv_word_count = 1.0 / documents[id].words.size();
+                for (const int word : documents[id].words) {
+                    postings[word].Add(static_cast<DocumentOrdinal>(id), inv_word_count);
+                }
+            }
+        }
+
+        double checksum = 0.0;
+        {
+            LOG_DURATION("posting lists: scan"s);
+            for (const PostingList& list : postings) {
+                for (PostingCursor cursor(list, 0, DOCUMENT_COUNT); !cursor.AtEnd(); cursor.Next()) {
+                    checksum += cursor.TermFreq();
+                }
+            }
+        }
+
+        size_t matched_count = 0;
+        {
+            LOG_DURATION("posting lists: score queries"s);
+            const TfIdfModel model;
+            ScoreAccumulator accumulator;
+            for (const vector<int>& query : queries) {
+                accumulator.Reset(0, DOCUMENT_COUNT);
+                for (const int word : query) {
+                    const double inverse_document_freq = TfIdfModel::ComputeInverseDocumentFreq(DOCUMENT_COUNT,
+                        static_cast<uint32_t>(postings[word].size()));
+                    accumulator.AddPostings(postings[word], inverse_document_freq, model);
+                }
+                accumulator.ForEachMatched([&matched_count](DocumentOrdinal, double) {
+                    ++matched_count;
+                });
+            }
+        }
+        cout << "posting lists: checksum "s << checksum << ", matched "s << matched_count << endl;
+    }
+}
+
+int main()
+{
+    mt19937 generator(42);
+    const vector<TestDocument> documents = GenerateDocuments(generator);
+    const vector<vector<int>> queries = GenerateQueries(documents, generator);
+    BenchmarkMapLayout(documents, queries);
+    BenchmarkPostingLists(documents, queries);
+}
@@ -0,0 +1,509 @@
+#include "posting_list.h"
+#include "bit_packing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+namespace
+{
+    // location of one list inside the arrays shared by all lists of a snapshot
+    struct PostingListRecord
+    {
+        uint64_t first_posting;
+        uint64_t posting_count;
+        uint64_t first_block;
+        uint64_t block_count;
+        uint64_t first_packed_block;
+        uint64_t packed_block_count;
+        uint64_t first_packed_word;
+        uint64_t packed_word_count;
+        uint64_t packed_size;
+        double max_term_freq;
+    };
+
+    template <typename T>
+    MappedArray<T> GetRecordRange(const MappedArray<T>& values, uint64_t first, uint64_t count)
+    {
+        if (first > values.size() || count > values.size() - first) {
+            throw invalid_argument("Snapshot has a broken posting list"s);
+        }
+        return MappedArray<T>(values.data() + first, count);
+    }
+
+    template <typename T, typename GetArray>
+    void WriteConcatenated(const vector<PostingList>& lists, uint64_t total_count, SnapshotWriter& writer,
+        GetArray get_array)
+    {
+        writer.BeginArray(total_count);
+        for (const PostingList& postings : lists)
+        {
+            const MappedArray<T>& values = get_array(postings);
+            writer.WriteElements(values.data(), values.size());
+        }
+        writer.EndArray();
+    }
+}
+
+vector<PostingList> PostingList::Open(SnapshotReader& reader)
+{
+    const MappedArray<PostingListRecord> records = reader.ReadArray<PostingListRecord>();
+    const MappedArray<DocumentOrdinal> ordinals = reader.ReadArray<DocumentOrdinal>();
+    const MappedArray<double> term_freqs = reader.ReadArray<double>();
+    const MappedArray<PostingBlock> blocks = reader.ReadArray<PostingBlock>();
+    const MappedArray<PackedBlock> packed_blocks = reader.ReadArray<PackedBlock>();
+    const MappedArray<uint64_t> packed_words = reader.ReadArray<uint64_t>();
+
+    vector<PostingList> lists(records.size());
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        const PostingListRecord& record = records[i];
+        PostingList& postings = lists[i];
+        postings.ordinals_ = GetRecordRange(ordinals, record.first_posting, record.posting_count);
+        postings.term_freqs_ = GetRecordRange(term_freqs, record.first_posting, record.posting_count);
+        postings.blocks_ = GetRecordRange(blocks, record.first_block, record.block_count);
+        postings.packed_blocks_ = GetRecordRange(packed_blocks, record.first_packed_block, record.packed_block_count);
+        postings.packed_words_ = GetRecordRange(packed_words, record.first_packed_word, record.packed_word_count);
+        postings.packed_size_ = record.packed_size;
+        postings.max_term_freq_ = record.max_term_freq;
+        if ((postings.size() + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE != postings.blocks_.size()
+            || (postings.IsCompressed() && postings.packed_blocks_.size() != postings.blocks_.size()))
+        {
+            throw invalid_argument("Snapshot has a broken posting list"s);
+        }
+    }
+    return lists;
+}
+
+void PostingList::Save(const vector<PostingList>& lists, SnapshotWriter& writer)
+{
+    vector<PostingListRecord> records;
+    records.reserve(lists.size());
+    PostingListRecord total{};
+    for (const PostingList& postings : lists)
+    {
+        records.push_back({ total.posting_count, postings.ordinals_.size(),
+            total.block_count, postings.blocks_.size(),
+            total.packed_block_count, postings.packed_blocks_.size(),
+            total.packed_word_count, postings.packed_words_.size(),
+            postings.packed_size_, postings.max_term_freq_ });
+        total.posting_count += postings.ordinals_.size();
+        total.block_count += postings.blocks_.size();
+        total.packed_block_count += postings.packed_blocks_.size();
+        total.packed_word_count += postings.packed_words_.size();
+    }
+
+    writer.WriteArray(records.data(), records.size());
+    WriteConcatenated<DocumentOrdinal>(lists, total.posting_count, writer,
+        [](const PostingList& postings) -> const auto& { return postings.ordinals_; });
+    WriteConcatenated<double>(lists, total.posting_count, writer,
+        [](const PostingList& postings) -> const auto& { return postings.term_freqs_; });
+    WriteConcatenated<PostingBlock>(lists, total.block_count, writer,
+        [](const PostingList& postings) -> const auto& { return postings.blocks_; });
+    WriteConcatenated<PackedBlock>(lists, total.packed_block_count, writer,
+        [](const PostingList& postings) -> const auto& { return postings.packed_blocks_; });
+    WriteConcatenated<uint64_t>(lists, total.packed_word_count, writer,
+        [](const PostingList& postings) -> const auto& { return postings.packed_words_; });
+}
+
+void PostingList::Add(DocumentOrdinal ordinal, double term_freq)
+{
+    Decompress();
+    vector<DocumentOrdinal>& ordinals = ordinals_.Mutable();
+    vector<double>& term_freqs = term_freqs_.Mutable();
+    if (ordinals.empty() || ordinals.back() < ordinal)
+    {
+        vector<PostingBlock>& blocks = blocks_.Mutable();
+        if (ordinals.size() % POSTING_BLOCK_SIZE == 0)
+        {
+            blocks.push_back({ ordinal, term_freq });
+        }
+        else
+        {
+            blocks.back().last_ordinal = ordinal;
+            blocks.back().max_term_freq = max(blocks.back().max_term_freq, term_freq);
+        }
+        ordinals.push_back(ordinal);
+        term_freqs.push_back(term_freq);
+        max_term_freq_ = max(max_term_freq_, term_freq);
+        return;
+    }
+
+    auto it = lower_bound(ordinals.begin(), ordinals.end(), ordinal);
+    const size_t pos = it - ordinals.begin();
+    if (it != ordinals.end() && *it == ordinal)
+    {
+        term_freqs[pos] += term_freq;
+    }
+    else
+    {
+        ordinals.insert(it, ordinal);
+        term_freqs.insert(term_freqs.begin() + pos, term_freq);
+    }
+    RebuildBlocks(pos / POSTING_BLOCK_SIZE);
+}
+
+bool PostingList::Erase(DocumentOrdinal ordinal)
+{
+    if (!Contains(ordinal))
+    {
+        return false;
+    }
+    Decompress();
+    vector<DocumentOrdinal>& ordinals = ordinals_.Mutable();
+    vector<double>& term_freqs = term_freqs_.Mutable();
+    auto it = lower_bound(ordinals.begin(), ordinals.end(), ordinal);
+    const size_t pos = it - ordinals.begin();
+    ordinals.erase(it);
+    term_freqs.erase(term_freqs.begin() + pos);
+    RebuildBlocks(pos / POSTING_BLOCK_SIZE);
+    return true;
+}
+
+bool PostingList::Contains(DocumentOrdinal ordinal) const
+{
+    if (!IsCompressed())
+    {
+        return binary_search(ordinals_.begin(), ordinals_.end(), ordinal);
+    }
+    if (ordinal == numeric_limits<DocumentOrdinal>::max())
+    {
+        return false;
+    }
+    return !PostingCursor(*this, ordinal, ordinal + 1).AtEnd();
+}
+
+void PostingList::Compact()
+{
+    if (!ordinals_.IsMapped())
+    {
+        ordinals_.Mutable().shrink_to_fit();
+        term_freqs_.Mutable().shrink_to_fit();
+    }
+    if (!blocks_.IsMapped())
+    {
+        blocks_.Mutable().shrink_to_fit();
+    }
+}
+
+void PostingList::Compress(const uint32_t* document_lengths, DocumentOrdinal first_ordinal)
+{
+    if (IsCompressed() || ordinals_.empty())
+    {
+        return;
+    }
+
+    vector<uint32_t> counts(ordinals_.size());
+    for (size_t i = 0; i < ordinals_.size(); ++i)
+    {
+        const uint32_t length = document_lengths[ordinals_[i] - first_ordinal];
+        if (length == 0)
+        {
+            return;
+        }
+        counts[i] = static_cast<uint32_t>(llround(term_freqs_[i] * length));
+        if (counts[i] * (1.0 / length) != term_freqs_[i])
+        {
+            return;
+        }
+    }
+
+    vector<PackedBlock>& packed_blocks = packed_blocks_.Mutable();
+    vector<uint64_t>& packed_words = packed_words_.Mutable();
+    uint32_t deltas[POSTING_BLOCK_SIZE];
+    for (size_t start = 0; start < ordinals_.size(); start += POSTING_BLOCK_SIZE)
+    {
+        const size_t count = min(POSTING_BLOCK_SIZE, ordinals_.size() - start);
+        uint32_t max_delta = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            deltas[i] = i == 0 ? 0 : ordinals_[start + i] - ordinals_[start + i - 1];
+            max_delta = max(max_delta, deltas[i]);
+        }
+        const uint32_t max_count = *max_element(counts.begin() + start, counts.begin() + start + count);
+
+        PackedBlock block{ packed_words.size(), ordinals_[start], RequiredBits(max_delta), RequiredBits(max_count) };
+        PackBits(deltas, count, block.delta_bits, packed_words);
+        PackBits(counts.data() + start, count, block.count_bits, packed_words);
+        packed_blocks.push_back(block);
+    }
+
+    packed_size_ = ordinals_.size();
+    SetDocumentLengths(document_lengths, first_ordinal);
+    packed_words.shrink_to_fit();
+    packed_blocks.shrink_to_fit();
+    ordinals_ = MappedArray<DocumentOrdinal>();
+    term_freqs_ = MappedArray<double>();
+}
+
+void PostingList::SetDocumentLengths(const uint32_t* document_lengths, DocumentOrdinal first_ordinal)
+{
+    document_lengths_ = document_lengths;
+    lengths_first_ordinal_ = first_ordinal;
+}
+
+bool PostingList::IsCompressed() const
+{
+    return !packed_blocks_.empty();
+}
+
+size_t PostingList::size() const
+{
+    return IsCompressed() ? packed_size_ : ordinals_.size();
+}
+
+bool PostingList::empty() const
+{
+    return size() == 0;
+}
+
+size_t PostingList::GetMemoryUsage() const
+{
+    return sizeof(PostingList)
+        + ordinals_.GetMemoryUsage()
+        + term_freqs_.GetMemoryUsage()
+        + blocks_.GetMemoryUsage()
+        + packed_blocks_.GetMemoryUsage()
+        + packed_words_.GetMemoryUsage();
+}
+
+const MappedArray<PostingBlock>& PostingList::GetBlocks() const
+{
+    return blocks_;
+}
+
+double PostingList::GetMaxTermFreq() const
+{
+    return max_term_freq_;
+}
+
+void PostingList::Decompress()
+{
+    if (!IsCompressed())
+    {
+        return;
+    }
+
+    vector<DocumentOrdinal>& ordinals = ordinals_.Mutable();
+    vector<double>& term_freqs = term_freqs_.Mutable();
+    ordinals.resize(packed_size_);
+    term_freqs.resize(packed_size_);
+    uint32_t counts[POSTING_BLOCK_SIZE];
+    for (size_t block = 0; block < packed_blocks_.size(); ++block)
+    {
+        const size_t start = block * POSTING_BLOCK_SIZE;
+        DecodeBlock(block, ordinals.data() + start, counts);
+        for (size_t i = 0; i < GetBlockSize(block); ++i)
+        {
+            term_freqs[start + i] = GetTermFreq(ordinals[start + i], counts[i]);
+        }
+    }
+
+    packed_size_ = 0;
+    packed_blocks_ = MappedArray<PackedBlock>();
+    packed_words_ = MappedArray<uint64_t>();
+    SetDocumentLengths(nullptr, 0);
+}
+
+size_t PostingList::GetBlockSize(size_t block) const
+{
+    return min(POSTING_BLOCK_SIZE, size() - block * POSTING_BLOCK_SIZE);
+}
+
+void PostingList::DecodeOrdinals(size_t block, DocumentOrdinal* ordinals) const
+{
+    const PackedBlock& packed = packed_blocks_[block];
+    UnpackBits(packed_words_.data() + packed.first_word, GetBlockSize(block), packed.delta_bits, ordinals);
+    PrefixSum(packed.first_ordinal, ordinals, GetBlockSize(block));
+}
+
+void PostingList::DecodeBlock(size_t block, DocumentOrdinal* ordinals, uint32_t* counts) const
+{
+    const PackedBlock& packed = packed_blocks_[block];
+    const size_t count = GetBlockSize(block);
+    DecodeOrdinals(block, ordinals);
+    UnpackBits(packed_words_.data() + packed.first_word + PackedWordCount(count, packed.delta_bits), count,
+        packed.count_bits, counts);
+}
+
+double PostingList::GetTermFreq(DocumentOrdinal ordinal, uint32_t count) const
+{
+    return count * (1.0 / document_lengths_[ordinal - lengths_first_ordinal_]);
+}
+
+void PostingList::RebuildBlocks(size_t first_block)
+{
+    vector<PostingBlock>& blocks = blocks_.Mutable();
+    blocks.resize(first_block);
+    for (size_t start = first_block * POSTING_BLOCK_SIZE; start < ordinals_.size(); start += POSTING_BLOCK_SIZE)
+    {
+        const size_t end = min(start + POSTING_BLOCK_SIZE, ordinals_.size());
+        blocks.push_back({ ordinals_[end - 1], *max_element(term_freqs_.begin() + start, term_freqs_.begin() + end) });
+    }
+
+    max_term_freq_ = 0.0;
+    for (const PostingBlock& block : blocks_)
+    {
+        max_term_freq_ = max(max_term_freq_, block.max_term_freq);
+    }
+}
+
+PostingCursor::PostingCursor(const PostingList& postings, DocumentOrdinal first_ordinal, DocumentOrdinal last_ordinal)
+    : postings_(&postings)
+    , is_compressed_(postings.IsCompressed())
+    , begin_(0)
+    , end_(postings.size())
+    , position_(0)
+    , loaded_block_(numeric_limits<size_t>::max())
+{
+    // the block of first_ordinal is the one decoded first, the cursor starts there
+    const size_t first = LowerBound(first_ordinal);
+    end_ = LowerBound(last_ordinal);
+    position_ = min(first, end_);
+    begin_ = position_;
+    if (is_compressed_ && position_ < end_)
+    {
+        LoadBlock(position_ / POSTING_BLOCK_SIZE);
+    }
+}
+
+bool PostingCursor::AtEnd() const
+{
+    return position_ == end_;
+}
+
+DocumentOrdinal PostingCursor::Ordinal() const
+{
+    return is_compressed_ ? block_ordinals_[position_ % POSTING_BLOCK_SIZE] : postings_->ordinals_[position_];
+}
+
+double PostingCursor::TermFreq() const
+{
+    if (!is_compressed_)
+    {
+        return postings_->term_freqs_[position_];
+    }
+    const size_t i = position_ % POSTING_BLOCK_SIZE;
+    return postings_->GetTermFreq(block_ordinals_[i], block_counts_[i]);
+}
+
+void PostingCursor::Next()
+{
+    ++position_;
+    if (is_compressed_ && position_ < end_ && position_ % POSTING_BLOCK_SIZE == 0)
+    {
+        LoadBlock(position_ / POSTING_BLOCK_SIZE);
+    }
+}
+
+void PostingCursor::SeekBlock(DocumentOrdinal target)
+{
+    const MappedArray<PostingBlock>& blocks = postings_->GetBlocks();
+    size_t block = position_ / POSTING_BLOCK_SIZE;
+    if (position_ == end_ || blocks[block].last_ordinal >= target)
+    {
+        return;
+    }
+
+    size_t step = 1;
+    while (block + step < blocks.size() && blocks[block + step].last_ordinal < target)
+    {
+        block += step;
+        step *= 2;
+    }
+    const size_t high = min(block + step, blocks.size());
+    block = lower_bound(blocks.begin() + block + 1, blocks.begin() + high, target,
+        [](const PostingBlock& lhs, DocumentOrdinal rhs) {
+            return lhs.last_ordinal < rhs;
+        }) - blocks.begin();
+    position_ = min(block * POSTING_BLOCK_SIZE, end_);
+    if (is_compressed_ && position_ < end_)
+    {
+        LoadBlock(block);
+    }
+}
+
+void PostingCursor::SeekTo(DocumentOrdinal target)
+{
+    SeekBlock(target);
+    if (position_ == end_ || Ordinal() >= target)
+    {
+        return;
+    }
+
+    const size_t block_end = min((position_ / POSTING_BLOCK_SIZE + 1) * POSTING_BLOCK_SIZE, end_);
+    position_ = SearchLoadedBlock(position_, block_end, target);
+}
+
+double PostingCursor::GetBlockMaxTermFreq() const
+{
+    if (position_ == end_)
+    {
+        return 0.0;
+    }
+    return postings_->GetBlocks()[position_ / POSTING_BLOCK_SIZE].max_term_freq;
+}
+
+size_t PostingCursor::GetPostingCount() const
+{
+    return end_ - begin_;
+}
+
+size_t PostingCursor::LowerBound(DocumentOrdinal target)
+{
+    const MappedArray<PostingBlock>& blocks = postings_->GetBlocks();
+    const size_t block = lower_bound(blocks.begin(), blocks.end(), target,
+        [](const PostingBlock& lhs, DocumentOrdinal rhs) {
+            return lhs.last_ordinal < rhs;
+        }) - blocks.begin();
+    if (block == blocks.size())
+    {
+        return postings_->size();
+    }
+
+    const size_t block_start = block * POSTING_BLOCK_SIZE;
+    const size_t block_end = block_start + postings_->GetBlockSize(block);
+    if (!is_compressed_)
+    {
+        return SearchLoadedBlock(block_start, block_end, target);
+    }
+    // a bound at or before the first posting of its block needs no decoding, as for the whole range of a segment
+    if (target <= postings_->packed_blocks_[block].first_ordinal)
+    {
+        return block_start;
+    }
+    if (loaded_block_ == numeric_limits<size_t>::max())
+    {
+        LoadBlock(block);
+    }
+    if (loaded_block_ == block)
+    {
+        return SearchLoadedBlock(block_start, block_end, target);
+    }
+    DocumentOrdinal ordinals[POSTING_BLOCK_SIZE];
+    postings_->DecodeOrdinals(block, ordinals);
+    return block_start + (lower_bound(ordinals, ordinals + (block_end - block_start), target) - ordinals);
+}
+
+size_t PostingCursor::SearchLoadedBlock(size_t from, size_t to, DocumentOrdinal target) const
+{
+    if (!is_compressed_)
+    {
+        const MappedArray<DocumentOrdinal>& ordinals = postings_->ordinals_;
+        return lower_bound(ordinals.begin() + from, ordinals.begin() + to, target) - ordinals.begin();
+    }
+    const size_t block_start = from / POSTING_BLOCK_SIZE * POSTING_BLOCK_SIZE;
+    return block_start + (lower_bound(block_ordinals_.begin() + (from - block_start),
+        block_ordinals_.begin() + (to - block_start), target) - block_ordinals_.begin());
+}
+
+void PostingCursor::LoadBlock(size_t block)
+{
+    if (loaded_block_ != block)
+    {
+        postings_->DecodeBlock(block, block_ordinals_.data(), block_counts_.data());
+        loaded_block_ = block;
+    }
+}
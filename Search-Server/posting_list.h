@@ -0,0 +1,142 @@
+#pragma once
+
+#include "mapped_array.h"
+#include "snapshot.h"
+
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Dense internal number of a document, given in the order documents are added
+using DocumentOrdinal = uint32_t;
+
+const size_t POSTING_BLOCK_SIZE = 128;
+
+enum class PostingEncoding
+{
+    PLAIN,
+    COMPRESSED,
+};
+
+// Skip entry for POSTING_BLOCK_SIZE consecutive postings
+struct PostingBlock
+{
+    DocumentOrdinal last_ordinal;
+    double max_term_freq;
+};
+
+// Postings of a single word: ordinals and term frequencies kept in two parallel arrays sorted by ordinal.
+// A compressed list keeps every block as bit-packed ordinal deltas and word counts instead, and goes back
+// to the plain arrays on the first modification. Term frequencies are restored from the counts and
+// the document lengths of the segment, which the list refers to.
+// Lists of an opened snapshot refer to the mapped file and copy their arrays on the first modification too
+class PostingList
+{
+public:
+    static std::vector<PostingList> Open(SnapshotReader& reader);
+
+    static void Save(const std::vector<PostingList>& lists, SnapshotWriter& writer);
+
+    void Add(DocumentOrdinal ordinal, double term_freq);
+
+    bool Erase(DocumentOrdinal ordinal);
+
+    bool Contains(DocumentOrdinal ordinal) const;
+
+    void Compact();
+
+    // document_lengths[i] is the length of the document first_ordinal + i, they are read again on every decode
+    // and have to outlive the list. Term frequencies have to be word_count * (1.0 / document_length)
+    // to be restored exactly, a list where some frequency is not stays plain
+    void Compress(const uint32_t* document_lengths, DocumentOrdinal first_ordinal);
+
+    // points a compressed list at its document lengths again after they moved, as Compress describes
+    void SetDocumentLengths(const uint32_t* document_lengths, DocumentOrdinal first_ordinal);
+
+    bool IsCompressed() const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    size_t GetMemoryUsage() const;
+
+    const MappedArray<PostingBlock>& GetBlocks() const;
+
+    double GetMaxTermFreq() const;
+
+private:
+    friend class PostingCursor;
+
+    struct PackedBlock {
+        size_t first_word;
+        DocumentOrdinal first_ordinal;
+        uint8_t delta_bits;
+        uint8_t count_bits;
+    };
+
+    void Decompress();
+
+    size_t GetBlockSize(size_t block) const;
+
+    void DecodeOrdinals(size_t block, DocumentOrdinal* ordinals) const;
+
+    void DecodeBlock(size_t block, DocumentOrdinal* ordinals, uint32_t* counts) const;
+
+    double GetTermFreq(DocumentOrdinal ordinal, uint32_t count) const;
+
+    void RebuildBlocks(size_t first_block);
+
+    MappedArray<DocumentOrdinal> ordinals_;
+    MappedArray<double> term_freqs_;
+    MappedArray<PostingBlock> blocks_;
+    MappedArray<PackedBlock> packed_blocks_;
+    MappedArray<uint64_t> packed_words_;
+    size_t packed_size_ = 0;
+    double max_term_freq_ = 0.0;
+    const uint32_t* document_lengths_ = nullptr;
+    DocumentOrdinal lengths_first_ordinal_ = 0;
+};
+
+// Forward-only iterator over the postings of [first_ordinal, last_ordinal), decoding compressed blocks on the fly
+// into buffers of its own, so it never allocates
+class PostingCursor
+{
+public:
+    PostingCursor(const PostingList& postings, DocumentOrdinal first_ordinal, DocumentOrdinal last_ordinal);
+
+    bool AtEnd() const;
+
+    DocumentOrdinal Ordinal() const;
+
+    double TermFreq() const;
+
+    void Next();
+
+    // skips every block whose postings are all below target, without looking inside the blocks
+    void SeekBlock(DocumentOrdinal target);
+
+    // moves to the first posting with ordinal >= target
+    void SeekTo(DocumentOrdinal target);
+
+    double GetBlockMaxTermFreq() const;
+
+    size_t GetPostingCount() const;
+
+private:
+    size_t LowerBound(DocumentOrdinal target);
+
+    size_t SearchLoadedBlock(size_t from, size_t to, DocumentOrdinal target) const;
+
+    void LoadBlock(size_t block);
+
+    const PostingList* postings_;
+    bool is_compressed_;
+    size_t begin_;
+    size_t end_;
+    size_t position_;
+    size_t loaded_block_;
+    std::array<DocumentOrdinal, POSTING_BLOCK_SIZE> block_ordinals_;
+    std::array<uint32_t, POSTING_BLOCK_SIZE> block_counts_;
+};
@@ -5,12 +5,13 @@
 #include <execution>
 #include <algorithm>
 #include <numeric>
-#include <list>
 
+// every posting list is read once for the whole batch, see SearchServer::FindTopDocumentsBatch
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
-std::list<Document> ProcessQueriesJoined(
+// results of all queries one after another in a single array
+std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
\ No newline at end of file
@@ -1,34 +1,102 @@
 #include "remove_duplicates_h.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <execution>
+#include <iostream>
+
 using namespace std;
 
-void RemoveDuplicates(SearchServer& search_server) 
+namespace
 {
-    set<set<string_view>> documents;
-    vector<int> documents_to_remove;
+    struct DocumentHash
+    {
+        uint64_t low;
+        uint64_t high;
+
+        bool operator<(const DocumentHash& other) const
+        {
+            return tie(low, high) < tie(other.low, other.high);
+        }
+
+        bool operator==(const DocumentHash& other) const
+        {
+            return low == other.low && high == other.high;
+        }
+    };
+
+    uint64_t Mix(uint64_t value)
+    {
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+        return value ^ (value >> 31);
+    }
 
-    for (int document_id : search_server) 
+    // two independently seeded chains over the sorted term ids, so equal word sets always hash equally
+    DocumentHash ComputeDocumentHash(TermFrequencies word_freqs)
     {
-        const auto& words = search_server.GetWordFrequencies(document_id);
-        set<string_view> doc_words;
-        transform(words.begin(), words.end(), inserter(doc_words, doc_words.begin()), [](const auto& el)
+        DocumentHash hash{ Mix(word_freqs.size()), Mix(word_freqs.size() ^ 0x9E3779B97F4A7C15ull) };
+        for (const auto& [word, term_freq] : word_freqs)
         {
-            return el.first;
+            hash.low = Mix(hash.low ^ word);
+            hash.high = Mix(hash.high + word * 0xC2B2AE3D27D4EB4Full);
+        }
+        return hash;
+    }
+
+    bool HaveSameWords(TermFrequencies lhs, TermFrequencies rhs)
+    {
+        return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+            [](const pair<TermId, double>& lhs_word, const pair<TermId, double>& rhs_word)
+            {
+                return lhs_word.first == rhs_word.first;
+            });
+    }
+}
+
+// Documents are grouped by the hash of their word set, words are compared only inside a group.
+// The document with the smallest id of every set of duplicates is kept
+void RemoveDuplicates(SearchServer& search_server) 
+{
+    const vector<int> document_ids(search_server.begin(), search_server.end());
+    vector<pair<DocumentHash, int>> hashes(document_ids.size());
+    transform(execution::par, document_ids.begin(), document_ids.end(), hashes.begin(), [&](int document_id)
+        {
+            return make_pair(ComputeDocumentHash(search_server.GetTermFrequencies(document_id)), document_id);
         });
+    sort(execution::par, hashes.begin(), hashes.end());
 
-        if (documents.count(doc_words))
+    vector<int> documents_to_remove;
+    vector<int> originals;
+    for (size_t start = 0, end = 0; start < hashes.size(); start = end)
+    {
+        while (end < hashes.size() && hashes[end].first == hashes[start].first)
         {
-            documents_to_remove.push_back(document_id);
+            ++end;
         }
-
-        else
+        // a collision of different word sets gives a group more than one original
+        originals.clear();
+        for (size_t i = start; i < end; ++i)
         {
-            documents.insert(doc_words);
+            const TermFrequencies word_freqs = search_server.GetTermFrequencies(hashes[i].second);
+            const bool is_duplicate = any_of(originals.begin(), originals.end(), [&](int original)
+                {
+                    return HaveSameWords(search_server.GetTermFrequencies(original), word_freqs);
+                });
+            if (is_duplicate)
+            {
+                documents_to_remove.push_back(hashes[i].second);
+            }
+            else
+            {
+                originals.push_back(hashes[i].second);
+            }
         }
     }
-    
+
+    sort(documents_to_remove.begin(), documents_to_remove.end());
     for (int document_id : documents_to_remove) {
         cout << "Found duplicate document id " << document_id << "\n";
-        search_server.RemoveDocument(document_id);
     }
-}
\ No newline at end of file
+    search_server.RemoveDocuments(documents_to_remove);
+}
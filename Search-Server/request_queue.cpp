@@ -7,11 +7,10 @@ RequestQueue::RequestQueue(const SearchServer& search_server)
 {
 }
 
+// goes through the status overload of the server, which can answer from its query cache
 vector<Document> RequestQueue::AddFindRequest(string_view raw_query, DocumentStatus status)
 {
-    return AddFindRequest(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status;
-        });
+    return AddRequestResult(data_base_.FindTopDocuments(raw_query, status));
 }
 
 vector<Document> RequestQueue::AddFindRequest(string_view raw_query)
@@ -24,3 +23,25 @@ int RequestQueue::GetNoResultRequests() const
     return empty_count_;
 }
 
+vector<Document> RequestQueue::AddRequestResult(vector<Document> find_results)
+{
+    ++time;
+    bool is_empty = false;
+    if (time > min_in_day_)
+    {
+        if (requests_.front().is_empty == true)
+        {
+            --empty_count_;
+        }
+        requests_.pop_front();
+    }
+
+    if (find_results.empty())
+    {
+        ++empty_count_;
+        is_empty = true;
+    }
+    requests_.push_back({ find_results, is_empty });
+    return find_results;
+}
+
@@ -21,6 +21,8 @@ public:
     int GetNoResultRequests() const;
 
 private:
+    std::vector<Document> AddRequestResult(std::vector<Document> find_results);
+
     struct QueryResult {
         std::vector<Document> request_result;
         bool is_empty;
@@ -35,23 +37,5 @@ private:
 
 template <typename DocumentPredicate>
 std::vector<Document> RequestQueue::AddFindRequest(std::string_view raw_query, DocumentPredicate document_predicate) {
-    ++time;
-    std::vector<Document> find_results = data_base_.FindTopDocuments(raw_query, document_predicate);
-    bool is_empty = false;
-    if (time > min_in_day_)
-    {
-        if (requests_.front().is_empty == true)
-        {
-            --empty_count_;
-        }
-        requests_.pop_front();
-    }
-
-    if (find_results.empty())
-    {
-        ++empty_count_;
-        is_empty = true;
-    }
-    requests_.push_back({ find_results, is_empty });
-    return find_results;
+    return AddRequestResult(data_base_.FindTopDocuments(raw_query, document_predicate));
 }
@@ -0,0 +1,105 @@
+#include "score_accumulator.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+    // matched ordinals are put in order by a scan of the states once more than 1 of this many slots is matched
+    const size_t DENSE_MATCH_RATIO = 32;
+}
+
+ScoreAccumulator::ScoreAccumulator(DocumentOrdinal first_ordinal, DocumentOrdinal last_ordinal)
+{
+    Reset(first_ordinal, last_ordinal);
+}
+
+void ScoreAccumulator::Reset(DocumentOrdinal first_ordinal, DocumentOrdinal last_ordinal)
+{
+    for (const DocumentOrdinal ordinal : matched_)
+    {
+        const size_t slot = ordinal - first_ordinal_;
+        relevance_[slot] = 0.0;
+        states_[slot] = State::NONE;
+    }
+    matched_.clear();
+    is_matched_sorted_ = true;
+    scored_posting_count_ = 0;
+    skipped_posting_count_ = 0;
+    first_ordinal_ = first_ordinal;
+    last_ordinal_ = last_ordinal;
+    const size_t size = last_ordinal - first_ordinal;
+    if (relevance_.size() < size)
+    {
+        relevance_.resize(size, 0.0);
+        states_.resize(size, State::NONE);
+    }
+}
+
+void ScoreAccumulator::ExcludePostings(const PostingList& postings)
+{
+    PostingCursor cursor(postings, first_ordinal_, last_ordinal_);
+    if (cursor.GetPostingCount() <= matched_.size())
+    {
+        for (; !cursor.AtEnd(); cursor.Next())
+        {
+            State& state = states_[cursor.Ordinal() - first_ordinal_];
+            if (state == State::MATCHED)
+            {
+                state = State::EXCLUDED;
+            }
+        }
+        return;
+    }
+
+    SortMatched();
+    for (const DocumentOrdinal ordinal : matched_)
+    {
+        cursor.SeekTo(ordinal);
+        if (cursor.AtEnd())
+        {
+            break;
+        }
+        if (cursor.Ordinal() == ordinal)
+        {
+            states_[ordinal - first_ordinal_] = State::EXCLUDED;
+        }
+    }
+}
+
+void ScoreAccumulator::SortMatched()
+{
+    if (is_matched_sorted_)
+    {
+        return;
+    }
+    const size_t size = last_ordinal_ - first_ordinal_;
+    if (matched_.size() > size / DENSE_MATCH_RATIO)
+    {
+        // reading the states in order is cheaper than sorting this many ordinals
+        matched_.clear();
+        for (size_t slot = 0; slot < size; ++slot)
+        {
+            if (states_[slot] != State::NONE)
+            {
+                matched_.push_back(static_cast<DocumentOrdinal>(first_ordinal_ + slot));
+            }
+        }
+    }
+    else
+    {
+        sort(matched_.begin(), matched_.end());
+    }
+    is_matched_sorted_ = true;
+}
+
+uint64_t ScoreAccumulator::GetScoredPostingCount() const
+{
+    return scored_posting_count_;
+}
+
+uint64_t ScoreAccumulator::GetSkippedPostingCount() const
+{
+    return skipped_posting_count_;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "ordinal_bitmap.h"
+#include "posting_list.h"
+
+#include <cstdint>
+#include <vector>
+
+// Dense relevance array for the ordinals [first_ordinal, last_ordinal).
+// Parallel queries give every worker its own range, so no locking is needed. The arrays are kept across Reset,
+// which clears only the slots the previous range touched, so a query costs as much as the postings it reads
+class ScoreAccumulator
+{
+public:
+    ScoreAccumulator() = default;
+
+    ScoreAccumulator(DocumentOrdinal first_ordinal, DocumentOrdinal last_ordinal);
+
+    void Reset(DocumentOrdinal first_ordinal, DocumentOrdinal last_ordinal);
+
+    // adds model.ScoreTerm(ordinal, term_freq) * inverse_document_freq for every posting,
+    // except those of ordinals missing from accepted_ordinals unless it is nullptr
+    template <typename Model>
+    void AddPostings(const PostingList& postings, double inverse_document_freq, const Model& model,
+        const OrdinalBitmap* accepted_ordinals = nullptr);
+
+    // Only documents matched already can be excluded, so it goes after every AddPostings.
+    // Short lists are walked, long ones are only probed for the matched documents, skipping whole blocks
+    void ExcludePostings(const PostingList& postings);
+
+    // in increasing order of ordinals
+    template <typename Callback>
+    void ForEachMatched(Callback callback);
+
+    // postings AddPostings scored and passed over for their ordinals since the last Reset
+    uint64_t GetScoredPostingCount() const;
+
+    uint64_t GetSkippedPostingCount() const;
+
+private:
+    enum class State : char
+    {
+        NONE,
+        MATCHED,
+        EXCLUDED,
+    };
+
+    void SortMatched();
+
+    DocumentOrdinal first_ordinal_ = 0;
+    DocumentOrdinal last_ordinal_ = 0;
+    std::vector<double> relevance_;
+    std::vector<State> states_;
+    // every slot that is not NONE
+    std::vector<DocumentOrdinal> matched_;
+    bool is_matched_sorted_ = true;
+    uint64_t scored_posting_count_ = 0;
+    uint64_t skipped_posting_count_ = 0;
+};
+
+template <typename Model>
+void ScoreAccumulator::AddPostings(const PostingList& postings, double inverse_document_freq, const Model& model,
+    const OrdinalBitmap* accepted_ordinals)
+{
+    for (PostingCursor cursor(postings, first_ordinal_, last_ordinal_); !cursor.AtEnd(); cursor.Next())
+    {
+        const DocumentOrdinal ordinal = cursor.Ordinal();
+        if (accepted_ordinals != nullptr && !accepted_ordinals->Contains(ordinal))
+        {
+            ++skipped_posting_count_;
+            continue;
+        }
+        ++scored_posting_count_;
+        const size_t slot = ordinal - first_ordinal_;
+        relevance_[slot] += model.ScoreTerm(ordinal, cursor.TermFreq()) * inverse_document_freq;
+        if (states_[slot] == State::NONE)
+        {
+            states_[slot] = State::MATCHED;
+            is_matched_sorted_ = is_matched_sorted_ && (matched_.empty() || matched_.back() < ordinal);
+            matched_.push_back(ordinal);
+        }
+    }
+}
+
+template <typename Callback>
+void ScoreAccumulator::ForEachMatched(Callback callback)
+{
+    SortMatched();
+    for (const DocumentOrdinal ordinal : matched_)
+    {
+        const size_t slot = ordinal - first_ordinal_;
+        if (states_[slot] == State::MATCHED)
+        {
+            callback(ordinal, relevance_[slot]);
+        }
+    }
+}
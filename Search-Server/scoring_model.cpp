@@ -0,0 +1,39 @@
+#include "scoring_model.h"
+
+#include <algorithm>
+
+using namespace std;
+
+double TfIdfModel::ComputeInverseDocumentFreq(size_t document_count, uint32_t document_freq)
+{
+    return log(document_count * 1.0 / document_freq);
+}
+
+Bm25Model::Bm25Model(const Bm25Parameters& parameters, const uint32_t* document_lengths, double average_document_length)
+    : k1_(parameters.k1)
+    , b_(parameters.b)
+    , length_weight_(parameters.k1 * parameters.b / average_document_length)
+    , document_lengths_(document_lengths)
+{
+}
+
+double Bm25Model::ComputeInverseDocumentFreq(size_t document_count, uint32_t document_freq)
+{
+    return log(1.0 + (document_count - document_freq + 0.5) / (document_freq + 0.5));
+}
+
+InverseDocumentFreqCache::InverseDocumentFreqCache(const InverseDocumentFreqCache& other)
+{
+    Invalidate(other.capacity_);
+}
+
+void InverseDocumentFreqCache::Invalidate(size_t term_count)
+{
+    ++generation_;
+    if (term_count > capacity_)
+    {
+        // new entries have generation 0, which is never current
+        capacity_ = max(term_count, capacity_ * 2);
+        entries_ = make_unique<Entry[]>(capacity_);
+    }
+}
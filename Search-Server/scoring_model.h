@@ -0,0 +1,119 @@
+#pragma once
+
+#include "posting_list.h"
+#include "term_dictionary.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+enum class ScoringModel
+{
+    TF_IDF,
+    BM25,
+};
+
+struct Bm25Parameters
+{
+    // how fast repeats of a word stop adding to the score
+    double k1 = 1.2;
+    // how much a document longer than the average one is penalized, from 0 to 1
+    double b = 0.75;
+};
+
+// A document scores the sum of ScoreTerm(ordinal, term_freq) * idf over the query words it contains,
+// term_freq being the share of the document the word takes, as the postings store it.
+// The scoring loops take the model as a template parameter, so the choice costs nothing per posting
+class TfIdfModel
+{
+public:
+    static double ComputeInverseDocumentFreq(size_t document_count, uint32_t document_freq);
+
+    double ScoreTerm(DocumentOrdinal, double term_freq) const
+    {
+        return term_freq;
+    }
+
+    // the largest ScoreTerm of postings with term frequencies up to max_term_freq
+    double GetMaxTermScore(double max_term_freq) const
+    {
+        return max_term_freq;
+    }
+};
+
+class Bm25Model
+{
+public:
+    // document_lengths are by ordinal
+    Bm25Model(const Bm25Parameters& parameters, const uint32_t* document_lengths, double average_document_length);
+
+    static double ComputeInverseDocumentFreq(size_t document_count, uint32_t document_freq);
+
+    double ScoreTerm(DocumentOrdinal ordinal, double term_freq) const
+    {
+        const double length = document_lengths_[ordinal];
+        const double count = std::round(term_freq * length);
+        return count * (k1_ + 1.0) / (count + k1_ * (1.0 - b_) + length_weight_ * length);
+    }
+
+    // k1 * (1 - b) only lowers the score of a posting, without it the score grows with term_freq alone
+    double GetMaxTermScore(double max_term_freq) const
+    {
+        if (max_term_freq == 0.0)
+        {
+            return 0.0;
+        }
+        return (k1_ + 1.0) * max_term_freq / (max_term_freq + length_weight_);
+    }
+
+private:
+    double k1_;
+    double b_;
+    // k1 * b / average document length
+    double length_weight_;
+    const uint32_t* document_lengths_;
+};
+
+// Inverse document frequencies by term id, each computed on its first use after Invalidate().
+// Concurrent queries may compute the same entry at once, they store the same value
+class InverseDocumentFreqCache
+{
+public:
+    InverseDocumentFreqCache() = default;
+
+    // a copy starts empty
+    InverseDocumentFreqCache(const InverseDocumentFreqCache& other);
+
+    // makes every entry stale and room for term_count terms, must not run concurrently with Get
+    void Invalidate(size_t term_count);
+
+    template <typename Compute>
+    double Get(TermId term_id, Compute compute) const;
+
+private:
+    struct Entry
+    {
+        std::atomic<uint64_t> generation = 0;
+        std::atomic<double> value = 0.0;
+    };
+
+    std::unique_ptr<Entry[]> entries_;
+    size_t capacity_ = 0;
+    uint64_t generation_ = 1;
+};
+
+template <typename Compute>
+double InverseDocumentFreqCache::Get(TermId term_id, Compute compute) const
+{
+    Entry& entry = entries_[term_id];
+    if (entry.generation.load(std::memory_order_acquire) == generation_)
+    {
+        return entry.value.load(std::memory_order_relaxed);
+    }
+    const double value = compute();
+    entry.value.store(value, std::memory_order_relaxed);
+    entry.generation.store(generation_, std::memory_order_release);
+    return value;
+}
@@ -2,8 +2,53 @@
 #include "string_processing.h"
 #include "document.h"
 
+#include <cstdio>
+#include <fstream>
+#include <tuple>
+#include <unordered_map>
+
 using namespace std;
 
+namespace
+{
+    struct SnapshotDocument
+    {
+        int id;
+        int rating;
+        DocumentStatus status;
+        DocumentOrdinal ordinal;
+        uint64_t word_count;
+    };
+
+    // Calls found(word) for the words of sorted words the document has, while it returns true. A document has
+    // more words than a query as a rule, so every query word gallops on from the previous one
+    template <typename Callback>
+    void ForEachCommonWord(const vector<TermId>& words, TermFrequencies word_freqs, Callback found)
+    {
+        const auto* first = word_freqs.begin();
+        for (const TermId word : words) {
+            // steps of 1, 2, 4, ... until a range ending at or past the word, then a binary search in it
+            const auto* last = first;
+            for (size_t step = 1; last != word_freqs.end() && last->first < word; step *= 2) {
+                first = last + 1;
+                last = static_cast<size_t>(word_freqs.end() - first) > step ? first + step : word_freqs.end();
+            }
+            first = lower_bound(first, last, word, [](const pair<TermId, double>& word_freq, TermId word) {
+                return word_freq.first < word;
+                });
+            if (first == word_freqs.end()) {
+                return;
+            }
+            if (first->first == word) {
+                if (!found(word)) {
+                    return;
+                }
+                ++first;
+            }
+        }
+    }
+}
+
 SearchServer::SearchServer(string stop_words_text)
     : SearchServer(SearchServer(string_view(stop_words_text)))
 {
@@ -18,32 +63,382 @@ SearchServer::SearchServer(string_view str)
 void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status,
     const vector<int>& ratings)
 {
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    if ((document_id < 0) || (document_ordinals_.count(document_id) > 0)) {
         throw std::invalid_argument("Invalid document_id"s);
     }
-    const auto words = SplitIntoWordsNoStopView(document);
+    FinishMerge(false);
+    auto& words = document_words_;
+    SplitIntoWordsNoStopView(document, words);
+    query_cache_.Invalidate();
 
+    auto& word_ids = document_word_ids_;
+    word_ids.resize(words.size());
+    transform(words.begin(), words.end(), word_ids.begin(), [&](string_view word)
+        {
+            return term_dictionary_.Insert(word);
+        });
+    sort(word_ids.begin(), word_ids.end());
+    document_freqs_.resize(term_dictionary_.size());
+
+    const DocumentOrdinal ordinal = static_cast<DocumentOrdinal>(ordinal_to_document_id_.size());
     const double inv_word_count = 1.0 / words.size();
-    for (string_view word : words) {
-        auto insert_iter = word_collector_.insert(string(word));
-        word_to_document_freqs_[*insert_iter.first][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][*insert_iter.first] += inv_word_count;
+    for (size_t start = 0, end = 0; start < word_ids.size(); start = end) {
+        while (end < word_ids.size() && word_ids[end] == word_ids[start]) {
+            ++end;
+        }
+        word_freqs_.push_back({ word_ids[start], (end - start) * inv_word_count });
+    }
+    word_freq_offsets_.push_back(word_freqs_.size());
+    const TermFrequencies word_freqs = GetOrdinalTermFrequencies(ordinal);
+    for (const auto& [word, term_freq] : word_freqs) {
+        ++document_freqs_[word];
     }
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
+    inverse_document_freqs_.Invalidate(term_dictionary_.size());
+    mutable_segment_.AddDocument(ordinal, word_freqs);
+    if (has_min_hash_sketches_) {
+        min_hash_sketches_.push_back(ComputeMinHashSketch(word_freqs));
+    }
+    if (has_word_positions_) {
+        word_positions_.AddDocument(word_freqs.size(), FindWordPositions(document, word_freqs));
+    }
+    document_ordinals_.emplace(document_id, ordinal);
+    ordinal_to_document_id_.push_back(document_id);
+    document_lengths_.push_back(static_cast<uint32_t>(words.size()));
+    document_ratings_.push_back(ComputeAverageRating(ratings));
+    document_statuses_.push_back(status);
+    status_ordinals_[static_cast<size_t>(status)].Add(ordinal);
+    rating_ordinals_[document_ratings_.back()].Add(ordinal);
+    total_document_length_ += words.size();
     document_ids_.insert(document_id);
+
+    if (mutable_segment_.GetLastOrdinal() - mutable_segment_.GetFirstOrdinal() >= segment_document_count_) {
+        FreezeMutableSegment();
+    }
+}
+
+void SearchServer::AddDocuments(const vector<DocumentInput>& documents)
+{
+    AddDocuments(execution::seq, documents);
 }
 
 void SearchServer::RemoveDocument(int document_id)
 {
-    RemoveDocument(execution::seq, document_id);
+    if (document_ordinals_.count(document_id) == 0)
+    {
+        throw out_of_range("Invalid document_id"s);
+    }
+    FinishMerge(false);
+    MarkDocumentRemoved(document_id);
+    CompactWordFreqs();
+    StartMerge();
+}
+
+void SearchServer::RemoveDocuments(const vector<int>& document_ids)
+{
+    if (any_of(document_ids.begin(), document_ids.end(), [this](int document_id) {
+        return document_ordinals_.count(document_id) == 0;
+    })) {
+        throw out_of_range("Invalid document_id"s);
+    }
+    FinishMerge(false);
+    for (const int document_id : document_ids)
+    {
+        if (document_ordinals_.count(document_id) > 0)
+        {
+            MarkDocumentRemoved(document_id);
+        }
+    }
+    CompactWordFreqs();
+    StartMerge();
+}
+
+// merges every segment into one, dropping all postings of removed documents
+void SearchServer::CompactIndex(PostingEncoding encoding)
+{
+    WaitForMerges();
+    segment_encoding_ = encoding;
+    const vector<const IndexSegment*> segments = GetSegments();
+    const DocumentOrdinal first_ordinal = segments.front()->GetFirstOrdinal();
+    const DocumentOrdinal last_ordinal = segments.back()->GetLastOrdinal();
+    if (first_ordinal == last_ordinal)
+    {
+        return;
+    }
+
+    auto merged = make_shared<const IndexSegment>(IndexSegment::Merge(segments,
+        GetRemovedOrdinals(first_ordinal, last_ordinal), encoding, document_lengths_));
+    frozen_segments_.assign(1, { merged, 0 });
+    mutable_segment_ = IndexSegment(last_ordinal);
+    if (has_word_positions_)
+    {
+        word_positions_.Compact(GetRemovedOrdinals(first_ordinal, last_ordinal));
+    }
+}
+
+size_t SearchServer::GetIndexMemoryUsage() const
+{
+    size_t memory_usage = 0;
+    for (const IndexSegment* segment : GetSegments())
+    {
+        memory_usage += segment->GetMemoryUsage();
+    }
+    for (const OrdinalBitmap& ordinals : status_ordinals_)
+    {
+        memory_usage += ordinals.GetMemoryUsage();
+    }
+    for (const auto& [rating, ordinals] : rating_ordinals_)
+    {
+        memory_usage += ordinals.GetMemoryUsage();
+    }
+    memory_usage += word_freqs_.capacity() * sizeof(word_freqs_[0])
+        + word_freq_offsets_.capacity() * sizeof(word_freq_offsets_[0])
+        + document_freqs_.capacity() * sizeof(document_freqs_[0])
+        + ordinal_to_document_id_.capacity() * sizeof(ordinal_to_document_id_[0])
+        + document_lengths_.capacity() * sizeof(document_lengths_[0])
+        + document_ratings_.capacity() * sizeof(document_ratings_[0])
+        + document_statuses_.capacity() * sizeof(document_statuses_[0])
+        + min_hash_sketches_.capacity() * sizeof(MinHashSketch);
+    return memory_usage + word_positions_.GetMemoryUsage();
+}
+
+void SearchServer::SetSegmentDocumentCount(size_t count)
+{
+    segment_document_count_ = max<size_t>(count, 1);
+}
+
+size_t SearchServer::GetSegmentCount() const
+{
+    return frozen_segments_.size() + 1;
+}
+
+void SearchServer::WaitForMerges()
+{
+    while (pending_merge_.valid())
+    {
+        FinishMerge(true);
+    }
+}
+
+void SearchServer::SetMinHashSketches(bool enabled)
+{
+    has_min_hash_sketches_ = enabled;
+    min_hash_sketches_.clear();
+    if (!enabled)
+    {
+        min_hash_sketches_.shrink_to_fit();
+        return;
+    }
+    // sketches of removed documents are never read, they only keep the ordinals aligned
+    min_hash_sketches_.resize(ordinal_to_document_id_.size());
+    vector<size_t> ordinals(ordinal_to_document_id_.size());
+    iota(ordinals.begin(), ordinals.end(), 0);
+    ForEachInParallel(execution::par, ordinals.begin(), ordinals.end(), [this](size_t ordinal)
+        {
+            min_hash_sketches_[ordinal] = ComputeMinHashSketch(GetOrdinalTermFrequencies(static_cast<DocumentOrdinal>(ordinal)));
+        }, TaskPriority::LOW);
+}
+
+bool SearchServer::HasMinHashSketches() const
+{
+    return has_min_hash_sketches_;
+}
+
+void SearchServer::SetWordPositions(bool enabled)
+{
+    if (enabled && !has_word_positions_ && !ordinal_to_document_id_.empty())
+    {
+        throw invalid_argument("Word positions have to be turned on before documents are added"s);
+    }
+    has_word_positions_ = enabled;
+    if (!enabled)
+    {
+        word_positions_ = PositionIndex();
+    }
+}
+
+bool SearchServer::HasWordPositions() const
+{
+    return has_word_positions_;
+}
+
+const MinHashSketch& SearchServer::GetMinHashSketch(int document_id) const
+{
+    if (!has_min_hash_sketches_) {
+        throw invalid_argument("MinHash sketches are off"s);
+    }
+    return min_hash_sketches_[document_ordinals_.at(document_id)];
+}
+
+void SearchServer::SaveSnapshot(const string& path) const
+{
+    const string temporary_path = path + ".tmp"s;
+    ofstream out(temporary_path, ios::binary | ios::trunc);
+    if (!out) {
+        throw invalid_argument("Cannot write snapshot "s + path);
+    }
+    SnapshotWriter writer(out);
+
+    string stop_words_text;
+    for (const string& stop_word : stop_words_) {
+        stop_words_text += stop_words_text.empty() ? ""s : " "s;
+        stop_words_text += stop_word;
+    }
+    writer.WriteArray(stop_words_text.data(), stop_words_text.size());
+    term_dictionary_.Save(writer);
+    writer.WriteValue(static_cast<uint64_t>(frozen_segments_.size()));
+    for (const FrozenSegment& segment : frozen_segments_) {
+        segment.index->Save(writer);
+    }
+    mutable_segment_.Save(writer);
+    writer.WriteArray(ordinal_to_document_id_.data(), ordinal_to_document_id_.size());
+    writer.WriteArray(document_lengths_.data(), document_lengths_.size());
+
+    // documents go in the order of their ids
+    vector<SnapshotDocument> documents;
+    documents.reserve(document_ids_.size());
+    uint64_t word_count = 0;
+    for (const int document_id : document_ids_) {
+        const DocumentOrdinal ordinal = document_ordinals_.at(document_id);
+        const uint64_t document_word_count = GetOrdinalTermFrequencies(ordinal).size();
+        documents.push_back({ document_id, document_ratings_[ordinal], document_statuses_[ordinal], ordinal,
+            document_word_count });
+        word_count += document_word_count;
+    }
+    writer.WriteArray(documents.data(), documents.size());
+
+    writer.BeginArray(word_count);
+    for (const SnapshotDocument& document : documents) {
+        for (const auto& [word, term_freq] : GetOrdinalTermFrequencies(document.ordinal)) {
+            writer.WriteElements(&word, 1);
+        }
+    }
+    writer.EndArray();
+    writer.BeginArray(word_count);
+    for (const SnapshotDocument& document : documents) {
+        for (const auto& [word, term_freq] : GetOrdinalTermFrequencies(document.ordinal)) {
+            writer.WriteElements(&term_freq, 1);
+        }
+    }
+    writer.EndArray();
+    writer.WriteValue(static_cast<uint32_t>(has_min_hash_sketches_));
+    writer.WriteValue(static_cast<uint32_t>(has_word_positions_));
+    if (has_word_positions_) {
+        word_positions_.Save(writer);
+    }
+
+    out.close();
+    if (!out) {
+        remove(temporary_path.c_str());
+        throw invalid_argument("Cannot write snapshot "s + path);
+    }
+    // rename does not replace an existing file on every platform
+    if (rename(temporary_path.c_str(), path.c_str()) != 0
+        && (remove(path.c_str()) != 0 || rename(temporary_path.c_str(), path.c_str()) != 0)) {
+        remove(temporary_path.c_str());
+        throw invalid_argument("Cannot write snapshot "s + path);
+    }
+}
+
+SearchServer SearchServer::OpenSnapshot(const string& path)
+{
+    auto file = make_shared<const MappedFile>(path);
+    SnapshotReader reader(*file);
+
+    const MappedArray<char> stop_words_text = reader.ReadArray<char>();
+    SearchServer server(string_view(stop_words_text.data(), stop_words_text.size()));
+    server.snapshot_file_ = file;
+    server.term_dictionary_ = TermDictionary::Open(reader);
+    const uint64_t frozen_segment_count = reader.ReadValue<uint64_t>();
+    DocumentOrdinal segment_start = 0;
+    for (uint64_t i = 0; i < frozen_segment_count; ++i) {
+        auto segment = make_shared<const IndexSegment>(IndexSegment::Open(reader));
+        if (segment->GetFirstOrdinal() != segment_start) {
+            throw invalid_argument("Snapshot is inconsistent"s);
+        }
+        segment_start = segment->GetLastOrdinal();
+        server.frozen_segments_.push_back({ segment, 0 });
+    }
+    server.mutable_segment_ = IndexSegment::Open(reader);
+    const MappedArray<int> ordinal_to_document_id = reader.ReadArray<int>();
+    server.ordinal_to_document_id_.assign(ordinal_to_document_id.begin(), ordinal_to_document_id.end());
+    const MappedArray<uint32_t> document_lengths = reader.ReadArray<uint32_t>();
+    server.document_lengths_.assign(document_lengths.begin(), document_lengths.end());
+
+    const MappedArray<SnapshotDocument> documents = reader.ReadArray<SnapshotDocument>();
+    const MappedArray<TermId> words = reader.ReadArray<TermId>();
+    const MappedArray<double> term_freqs = reader.ReadArray<double>();
+    if (server.mutable_segment_.GetFirstOrdinal() != segment_start
+        || server.mutable_segment_.GetLastOrdinal() > server.ordinal_to_document_id_.size()
+        || server.document_lengths_.size() != server.ordinal_to_document_id_.size()
+        || words.size() != term_freqs.size()) {
+        throw invalid_argument("Snapshot is inconsistent"s);
+    }
+    server.document_freqs_.resize(server.term_dictionary_.size());
+    server.inverse_document_freqs_.Invalidate(server.term_dictionary_.size());
+
+    // the words of the documents are in the order of their ids, the server keeps them in the order of ordinals
+    const size_t ordinal_count = server.ordinal_to_document_id_.size();
+    server.document_ratings_.assign(ordinal_count, 0);
+    server.document_statuses_.assign(ordinal_count, DocumentStatus::REMOVED);
+    vector<pair<size_t, size_t>> word_ranges(ordinal_count);
+    size_t word_index = 0;
+    for (const SnapshotDocument& document : documents) {
+        if (document.ordinal >= ordinal_count
+            || server.ordinal_to_document_id_[document.ordinal] != document.id
+            || document.word_count > words.size() - word_index
+            || !server.document_ordinals_.emplace(document.id, document.ordinal).second) {
+            throw invalid_argument("Snapshot is inconsistent"s);
+        }
+        word_ranges[document.ordinal] = { word_index, word_index + document.word_count };
+        word_index += document.word_count;
+        server.document_ratings_[document.ordinal] = document.rating;
+        server.document_statuses_[document.ordinal] = document.status;
+        server.status_ordinals_[static_cast<size_t>(document.status)].Add(document.ordinal);
+        server.rating_ordinals_[document.rating].Add(document.ordinal);
+        server.total_document_length_ += server.document_lengths_[document.ordinal];
+        server.document_ids_.insert(server.document_ids_.end(), document.id);
+    }
+    server.word_freqs_.reserve(word_index);
+    server.word_freq_offsets_.reserve(ordinal_count + 1);
+    for (const auto& [first, last] : word_ranges) {
+        for (size_t i = first; i < last; ++i) {
+            if (words[i] >= server.term_dictionary_.size()) {
+                throw invalid_argument("Snapshot is inconsistent"s);
+            }
+            server.word_freqs_.push_back({ words[i], term_freqs[i] });
+            ++server.document_freqs_[words[i]];
+        }
+        server.word_freq_offsets_.push_back(server.word_freqs_.size());
+    }
+
+    for (FrozenSegment& segment : server.frozen_segments_) {
+        const vector<bool> is_removed = server.GetRemovedOrdinals(segment.index->GetFirstOrdinal(),
+            segment.index->GetLastOrdinal());
+        const size_t live_document_count = is_removed.size() - count(is_removed.begin(), is_removed.end(), true);
+        if (live_document_count > segment.index->GetDocumentCount()) {
+            throw invalid_argument("Snapshot is inconsistent"s);
+        }
+        segment.removed_document_count = segment.index->GetDocumentCount() - live_document_count;
+    }
+    // sketches are cheap to recompute, so only whether they are on is saved
+    server.SetMinHashSketches(reader.ReadValue<uint32_t>() != 0);
+    server.has_word_positions_ = reader.ReadValue<uint32_t>() != 0;
+    if (server.has_word_positions_) {
+        server.word_positions_ = PositionIndex::Open(reader);
+        if (server.word_positions_.GetDocumentCount() != server.ordinal_to_document_id_.size()) {
+            throw invalid_argument("Snapshot is inconsistent"s);
+        }
+    }
+    return server;
 }
 
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const
 {
-    return SearchServer::FindTopDocuments(
-        raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
+    const Query query = ParseQuery(raw_query);
+    return FindCachedTopDocuments(query, status, [&]()
+        {
+            return FindTopDocumentsForQuery(query, OrdinalPredicate{ &status_ordinals_[static_cast<size_t>(status)] });
         });
 }
 
@@ -52,19 +447,392 @@ vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const
     return SearchServer::FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, const DocumentFilter& filter) const
+{
+    const Query query = ParseQuery(raw_query);
+    OrdinalBitmap filter_ordinals;
+    return FindTopDocumentsForQuery(query, OrdinalPredicate{ FindFilterOrdinals(filter, filter_ordinals) });
+}
+
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(const vector<string>& raw_queries, DocumentStatus status) const
+{
+    vector<Query> queries(raw_queries.size());
+    vector<exception_ptr> errors(raw_queries.size());
+    vector<size_t> indices(raw_queries.size());
+    iota(indices.begin(), indices.end(), 0);
+    ForEachInParallel(execution::par, indices.begin(), indices.end(), [&](size_t i)
+        {
+            try {
+                queries[i] = ParseQuery(raw_queries[i]);
+            }
+            catch (...) {
+                errors[i] = current_exception();
+            }
+        });
+    for (const exception_ptr& error : errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+
+    vector<vector<Document>> results(queries.size());
+    const bool is_cached = query_cache_.GetCapacity() > 0;
+    const uint64_t generation = query_cache_.GetGeneration();
+    vector<size_t> missed;
+    vector<const Query*> missed_queries;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        optional<vector<Document>> documents;
+        if (is_cached) {
+            documents = query_cache_.Find({ queries[i].plus_words, queries[i].minus_words, queries[i].phrases,
+                queries[i].typo_words, status });
+        }
+        if (documents) {
+            results[i] = move(*documents);
+        }
+        else {
+            missed.push_back(i);
+            missed_queries.push_back(&queries[i]);
+        }
+    }
+
+    vector<vector<Document>> missed_results = FindTopDocumentsShared(missed_queries, status);
+    for (size_t i = 0; i < missed.size(); ++i) {
+        if (is_cached) {
+            const Query& query = queries[missed[i]];
+            query_cache_.Insert({ query.plus_words, query.minus_words, query.phrases, query.typo_words, status },
+                missed_results[i], generation);
+        }
+        results[missed[i]] = move(missed_results[i]);
+    }
+    return results;
+}
+
+// Term-at-a-time over all queries at once. Every part walks the posting lists of its ordinal range once,
+// QUERY_BATCH_BLOCK_SIZE ordinals at a time, and scatters every posting to the queries containing its word.
+// Contributions of a document are summed in the order of the term ids, as FindAllDocuments does
+vector<vector<Document>> SearchServer::FindTopDocumentsShared(const vector<const Query*>& queries,
+    DocumentStatus status) const
+{
+    // word -> queries containing it, twice the query index and 1 for a minus word
+    vector<pair<TermId, size_t>> word_queries;
+    for (size_t query = 0; query < queries.size(); ++query) {
+        for (const TermId word : queries[query]->plus_words) {
+            word_queries.push_back({ word, query * 2 });
+        }
+        for (const TermId word : queries[query]->minus_words) {
+            word_queries.push_back({ word, query * 2 + 1 });
+        }
+    }
+    sort(word_queries.begin(), word_queries.end());
+
+    // weights by entry of word_queries, a word standing for a misspelled one weighs less in its query
+    vector<TermId> words;
+    vector<double> weights(word_queries.size());
+    vector<size_t> offsets;
+    for (size_t i = 0; i < word_queries.size(); ++i) {
+        const auto [word, query] = word_queries[i];
+        if (i == 0 || word != word_queries[i - 1].first) {
+            words.push_back(word);
+            offsets.push_back(i);
+        }
+        weights[i] = ComputeQueryWordWeight(*queries[query / 2], word);
+    }
+    offsets.push_back(word_queries.size());
+
+    const OrdinalBitmap& status_ordinals = status_ordinals_[static_cast<size_t>(status)];
+    const vector<SegmentRange> ranges = SplitSegments(GetParallelism(execution::par));
+    vector<vector<vector<Document>>> part_documents(ranges.size(), vector<vector<Document>>(queries.size()));
+    vector<size_t> parts(ranges.size());
+    iota(parts.begin(), parts.end(), 0);
+    // the model is chosen once for the whole batch
+    VisitScoringModel([&](const auto& model) {
+        ForEachInParallel(execution::par, parts.begin(), parts.end(), [&](size_t part)
+            {
+                const SegmentRange& range = ranges[part];
+                vector<PostingCursor> cursors;
+                cursors.reserve(words.size());
+                for (const TermId word : words) {
+                    cursors.emplace_back(range.segment->GetPostings(word), range.first_ordinal, range.last_ordinal);
+                }
+
+                vector<vector<pair<DocumentOrdinal, double>>> scores(queries.size());
+                vector<vector<DocumentOrdinal>> excluded(queries.size());
+                vector<size_t> touched_queries;
+                vector<bool> is_touched(queries.size());
+                vector<vector<Document>>& top_documents = part_documents[part];
+                for (DocumentOrdinal block_first = range.first_ordinal; block_first < range.last_ordinal;
+                    block_first += static_cast<DocumentOrdinal>(QUERY_BATCH_BLOCK_SIZE)) {
+                    const DocumentOrdinal block_last = static_cast<DocumentOrdinal>(
+                        min<size_t>(block_first + QUERY_BATCH_BLOCK_SIZE, range.last_ordinal));
+                    for (size_t word = 0; word < words.size(); ++word) {
+                        for (PostingCursor& cursor = cursors[word]; !cursor.AtEnd() && cursor.Ordinal() < block_last; cursor.Next()) {
+                            // documents of other statuses are never scored
+                            if (!status_ordinals.Contains(cursor.Ordinal())) {
+                                continue;
+                            }
+                            const double term_score = model.ScoreTerm(cursor.Ordinal(), cursor.TermFreq());
+                            for (size_t i = offsets[word]; i < offsets[word + 1]; ++i) {
+                                const size_t query = word_queries[i].second / 2;
+                                if (!is_touched[query]) {
+                                    is_touched[query] = true;
+                                    touched_queries.push_back(query);
+                                }
+                                if (word_queries[i].second % 2 == 1) {
+                                    excluded[query].push_back(cursor.Ordinal());
+                                }
+                                else {
+                                    scores[query].push_back({ cursor.Ordinal(), term_score * weights[i] });
+                                }
+                            }
+                        }
+                    }
+
+                    for (const size_t query : touched_queries) {
+                        auto& query_scores = scores[query];
+                        auto& query_excluded = excluded[query];
+                        stable_sort(query_scores.begin(), query_scores.end(), [](const auto& lhs, const auto& rhs) {
+                            return lhs.first < rhs.first;
+                        });
+                        sort(query_excluded.begin(), query_excluded.end());
+                        auto excluded_position = query_excluded.begin();
+                        for (size_t start = 0, end = 0; start < query_scores.size(); start = end) {
+                            const DocumentOrdinal ordinal = query_scores[start].first;
+                            double relevance = 0.0;
+                            for (; end < query_scores.size() && query_scores[end].first == ordinal; ++end) {
+                                relevance += query_scores[end].second;
+                            }
+                            excluded_position = lower_bound(excluded_position, query_excluded.end(), ordinal);
+                            const int document_id = ordinal_to_document_id_[ordinal];
+                            if ((excluded_position != query_excluded.end() && *excluded_position == ordinal)
+                                || document_id == NO_DOCUMENT_ID) {
+                                continue;
+                            }
+                            if (IsDocumentAccepted(*queries[query], OrdinalPredicate{ &status_ordinals }, ordinal)) {
+                                PushTopDocument(top_documents[query],
+                                    Document(document_id, relevance, document_ratings_[ordinal]),
+                                    max_result_document_count_);
+                            }
+                        }
+                        query_scores.clear();
+                        query_excluded.clear();
+                        is_touched[query] = false;
+                    }
+                    touched_queries.clear();
+                }
+            });
+        });
+
+    vector<vector<Document>> results(queries.size());
+    for (size_t query = 0; query < queries.size(); ++query) {
+        for (vector<vector<Document>>& documents : part_documents) {
+            results[query].insert(results[query].end(), documents[query].begin(), documents[query].end());
+        }
+        SelectTopDocuments(results[query]);
+    }
+    return results;
+}
+
 int SearchServer::GetDocumentCount() const
 {
-    return documents_.size();
+    return static_cast<int>(document_ordinals_.size());
 }
 
-const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const
+void SearchServer::SetMaxResultDocumentCount(size_t count)
+{
+    max_result_document_count_ = count;
+    query_cache_.Invalidate();
+}
+
+size_t SearchServer::GetMaxResultDocumentCount() const
+{
+    return max_result_document_count_;
+}
+
+// cached results stay valid, the cache key holds the words a prefix was expanded into
+void SearchServer::SetMaxPrefixExpansions(size_t count)
+{
+    max_prefix_expansions_ = count;
+}
+
+size_t SearchServer::GetMaxPrefixExpansions() const
+{
+    return max_prefix_expansions_;
+}
+
+// cached results stay valid here too, the cache key holds the words a misspelled one was replaced with
+void SearchServer::SetTypoTolerance(uint32_t max_distance)
+{
+    if (max_distance > MAX_TYPO_DISTANCE) {
+        throw invalid_argument("Typo tolerance is at most "s + to_string(MAX_TYPO_DISTANCE) + " edits"s);
+    }
+    typo_distance_ = max_distance;
+}
 
+uint32_t SearchServer::GetTypoTolerance() const
+{
+    return typo_distance_;
+}
+
+void SearchServer::SetTypoPenalty(double penalty)
+{
+    if (!(penalty >= 0.0 && penalty <= 1.0)) {
+        throw invalid_argument("Typo penalty has to be between 0 and 1"s);
+    }
+    typo_penalty_ = penalty;
+    query_cache_.Invalidate();
+}
+
+double SearchServer::GetTypoPenalty() const
+{
+    return typo_penalty_;
+}
+
+void SearchServer::SetRetrievalStrategy(RetrievalStrategy strategy)
+{
+    retrieval_strategy_ = strategy;
+    query_cache_.Invalidate();
+}
+
+RetrievalStrategy SearchServer::GetRetrievalStrategy() const
+{
+    return retrieval_strategy_;
+}
+
+void SearchServer::SetScoringModel(ScoringModel model)
+{
+    scoring_model_ = model;
+    inverse_document_freqs_.Invalidate(term_dictionary_.size());
+    query_cache_.Invalidate();
+}
+
+ScoringModel SearchServer::GetScoringModel() const
+{
+    return scoring_model_;
+}
+
+void SearchServer::SetBm25Parameters(const Bm25Parameters& parameters)
+{
+    if (!(parameters.k1 >= 0.0) || !(parameters.b >= 0.0 && parameters.b <= 1.0)) {
+        throw invalid_argument("BM25 needs k1 >= 0 and b between 0 and 1"s);
+    }
+    bm25_parameters_ = parameters;
+    query_cache_.Invalidate();
+}
+
+const Bm25Parameters& SearchServer::GetBm25Parameters() const
+{
+    return bm25_parameters_;
+}
+
+PruningStats SearchServer::GetPruningStats() const
+{
+    return { pruning_counters_.scored_postings.load(), pruning_counters_.skipped_postings.load() };
+}
+
+void SearchServer::SetQueryCacheCapacity(size_t capacity)
+{
+    query_cache_.SetCapacity(capacity);
+}
+
+CacheStats SearchServer::GetQueryCacheStats() const
+{
+    return query_cache_.GetStats();
+}
+
+void SearchServer::SetThreadPool(shared_ptr<ThreadPool> thread_pool)
+{
+    thread_pool_ = move(thread_pool);
+}
+
+const shared_ptr<ThreadPool>& SearchServer::GetThreadPool() const
+{
+    return thread_pool_;
+}
+
+bool SearchServer::Phrase::operator==(const Phrase& other) const
+{
+    return words == other.words && offsets == other.offsets;
+}
+
+bool SearchServer::Phrase::operator<(const Phrase& other) const
+{
+    return tie(words, offsets) < tie(other.words, other.offsets);
+}
+
+bool SearchServer::QueryCacheKey::operator==(const QueryCacheKey& other) const
+{
+    return status == other.status && plus_words == other.plus_words && minus_words == other.minus_words
+        && phrases == other.phrases && typo_words == other.typo_words;
+}
+
+size_t SearchServer::QueryCacheKeyHasher::operator()(const QueryCacheKey& key) const
+{
+    uint64_t hash = 14695981039346656037ull ^ static_cast<uint64_t>(key.status);
+    for (const TermId word : key.plus_words) {
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    hash = (hash ^ NO_TERM) * 1099511628211ull;
+    for (const TermId word : key.minus_words) {
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    for (const Phrase& phrase : key.phrases) {
+        hash = (hash ^ NO_TERM) * 1099511628211ull;
+        for (size_t i = 0; i < phrase.words.size(); ++i) {
+            hash = (hash ^ phrase.words[i]) * 1099511628211ull;
+            hash = (hash ^ phrase.offsets[i]) * 1099511628211ull;
+        }
+    }
+    hash = (hash ^ NO_TERM) * 1099511628211ull;
+    for (const TermId word : key.typo_words) {
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    return static_cast<size_t>(hash ^ (hash >> 32));
+}
+
+SearchServer::PruningCounters::PruningCounters(const PruningCounters& other)
+    : scored_postings(other.scored_postings.load())
+    , skipped_postings(other.skipped_postings.load())
+{
+}
+
+SearchServer::WordFrequencyMaps::WordFrequencyMaps(const WordFrequencyMaps&)
+{
+}
+
+const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const
 {
     static const map<string_view, double> empty_map;
-    if (document_to_word_freqs_.count(document_id) == 0) {
+    if (document_ordinals_.count(document_id) == 0) {
         return empty_map;
     }
-    return document_to_word_freqs_.at(document_id);
+    lock_guard guard(word_frequency_maps_.mutex);
+    const auto [word_freqs, is_new] = word_frequency_maps_.maps.try_emplace(document_id);
+    if (is_new) {
+        for (const auto& [word, term_freq] : GetTermFrequencies(document_id)) {
+            word_freqs->second.emplace(term_dictionary_.GetTerm(word), term_freq);
+        }
+    }
+    return word_freqs->second;
+}
+
+TermFrequencies SearchServer::GetTermFrequencies(int document_id) const
+{
+    const auto ordinal = document_ordinals_.find(document_id);
+    return ordinal == document_ordinals_.end() ? TermFrequencies() : GetOrdinalTermFrequencies(ordinal->second);
+}
+
+vector<PostingBlock> SearchServer::GetPostingBlocks(string_view word) const
+{
+    vector<PostingBlock> blocks;
+    const TermId word_id = term_dictionary_.Find(word);
+    if (word_id == NO_TERM) {
+        return blocks;
+    }
+    for (const IndexSegment* segment : GetSegments()) {
+        const MappedArray<PostingBlock>& segment_blocks = segment->GetPostings(word_id).GetBlocks();
+        blocks.insert(blocks.end(), segment_blocks.begin(), segment_blocks.end());
+    }
+    return blocks;
 }
 
 using SetIterator = std::set<int>::const_iterator;
@@ -82,29 +850,35 @@ SetIterator SearchServer::end() const
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_view raw_query,
     int document_id) const
 {
-    const auto query = ParseQuery(raw_query);
-
     vector<string_view> matched_words;
+    const DocumentStatus status = MatchDocument(raw_query, document_id, matched_words);
+    return { move(matched_words), status };
+}
 
-    for (string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.clear();
-            return { matched_words, documents_.at(document_id).status };
-        }
-    }
-    for (string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.push_back(word);
-        }
-    }
+DocumentStatus SearchServer::MatchDocument(string_view raw_query, int document_id,
+    vector<string_view>& matched_words) const
+{
+    // callers match every document they show, so the query is parsed into buffers kept by the thread
+    thread_local Query query;
+    ParseQuery(raw_query, query);
+    const DocumentOrdinal ordinal = document_ordinals_.at(document_id);
+    const TermFrequencies word_freqs = GetOrdinalTermFrequencies(ordinal);
 
-    return { matched_words, documents_.at(document_id).status };
+    matched_words.clear();
+    bool has_minus_word = false;
+    ForEachCommonWord(query.minus_words, word_freqs, [&has_minus_word](TermId) {
+        has_minus_word = true;
+        return false;
+        });
+    if (has_minus_word || (!query.phrases.empty() && !ContainsPhrases(query.phrases, ordinal))) {
+        return document_statuses_[ordinal];
+    }
+    ForEachCommonWord(query.plus_words, word_freqs, [&](TermId word) {
+        matched_words.push_back(term_dictionary_.GetTerm(word));
+        return true;
+        });
+    sort(matched_words.begin(), matched_words.end());
+    return document_statuses_[ordinal];
 }
 
 bool SearchServer::IsStopWord(string_view word) const
@@ -119,18 +893,262 @@ bool SearchServer::IsValidWord(string_view word)
         });
 }
 
-vector<string_view> SearchServer::SplitIntoWordsNoStopView(string_view text) const
+void SearchServer::SplitIntoWordsNoStopView(string_view text, vector<string_view>& words) const
+{
+    const size_t invalid_word = SplitIntoWordsView(text, words);
+    if (invalid_word != words.size()) {
+        throw std::invalid_argument("Word "s + string(words[invalid_word]) + " is invalid"s);
+    }
+    words.erase(remove_if(words.begin(), words.end(), [this](string_view word)
+        {
+            return IsStopWord(word);
+        }), words.end());
+}
+
+void SearchServer::MarkDocumentRemoved(int document_id)
+{
+    query_cache_.Invalidate();
+    const DocumentOrdinal ordinal = document_ordinals_.at(document_id);
+    status_ordinals_[static_cast<size_t>(document_statuses_[ordinal])].Remove(ordinal);
+    const auto rating_ordinals = rating_ordinals_.find(document_ratings_[ordinal]);
+    rating_ordinals->second.Remove(ordinal);
+    if (rating_ordinals->second.size() == 0)
+    {
+        rating_ordinals_.erase(rating_ordinals);
+    }
+    const TermFrequencies word_freqs = GetOrdinalTermFrequencies(ordinal);
+    for (const auto& [word, term_freq] : word_freqs)
+    {
+        --document_freqs_[word];
+    }
+    removed_word_freq_count_ += word_freqs.size();
+    inverse_document_freqs_.Invalidate(term_dictionary_.size());
+    total_document_length_ -= document_lengths_[ordinal];
+    if (ordinal < mutable_segment_.GetFirstOrdinal())
+    {
+        ++frozen_segments_[FindFrozenSegment(ordinal)].removed_document_count;
+    }
+    ordinal_to_document_id_[ordinal] = NO_DOCUMENT_ID;
+
+    document_ids_.erase(document_id);
+    word_frequency_maps_.maps.erase(document_id);
+    document_ordinals_.erase(document_id);
+}
+
+// drops the term frequencies of removed documents once they take more than half of the storage,
+// so every frequency is copied O(1) times on average
+void SearchServer::CompactWordFreqs()
+{
+    if (removed_word_freq_count_ * 2 <= word_freqs_.size())
+    {
+        return;
+    }
+    vector<pair<TermId, double>> word_freqs;
+    word_freqs.reserve(word_freqs_.size() - removed_word_freq_count_);
+    for (size_t ordinal = 0; ordinal < ordinal_to_document_id_.size(); ++ordinal)
+    {
+        // the offset of the next ordinal is still the old one
+        const size_t first = word_freq_offsets_[ordinal];
+        word_freq_offsets_[ordinal] = word_freqs.size();
+        if (ordinal_to_document_id_[ordinal] != NO_DOCUMENT_ID)
+        {
+            word_freqs.insert(word_freqs.end(), word_freqs_.begin() + first,
+                word_freqs_.begin() + word_freq_offsets_[ordinal + 1]);
+        }
+    }
+    word_freq_offsets_.back() = word_freqs.size();
+    word_freqs_ = move(word_freqs);
+    removed_word_freq_count_ = 0;
+}
+
+TermFrequencies SearchServer::GetOrdinalTermFrequencies(DocumentOrdinal ordinal) const
+{
+    return TermFrequencies(word_freqs_.data() + word_freq_offsets_[ordinal],
+        word_freqs_.data() + word_freq_offsets_[ordinal + 1]);
+}
+
+void SearchServer::CheckNewDocumentIds(const vector<DocumentInput>& documents) const
+{
+    vector<int> document_ids(documents.size());
+    transform(documents.begin(), documents.end(), document_ids.begin(), [](const DocumentInput& document)
+        {
+            return document.id;
+        });
+    sort(document_ids.begin(), document_ids.end());
+    if (adjacent_find(document_ids.begin(), document_ids.end()) != document_ids.end()
+        || any_of(document_ids.begin(), document_ids.end(), [this](int document_id) {
+            return document_id < 0 || document_ordinals_.count(document_id) > 0;
+        })) {
+        throw std::invalid_argument("Invalid document_id"s);
+    }
+}
+
+vector<SearchServer::BatchPart> SearchServer::SplitBatch(size_t document_count, size_t part_count) const
 {
-    vector<string_view> words;
-    for (auto& word : SplitIntoWordsView(text)) {
-        if (!IsValidWord(word)) {
-            throw std::invalid_argument("Word "s + string(word) + " is invalid"s);
+    const size_t part_size = max<size_t>(1, (document_count + part_count - 1) / part_count);
+    const size_t first_ordinal = ordinal_to_document_id_.size();
+    size_t segment_end = max<size_t>(mutable_segment_.GetFirstOrdinal() + segment_document_count_, first_ordinal + 1);
+
+    vector<BatchPart> parts;
+    for (size_t first = 0; first < document_count;)
+    {
+        const size_t last = min({ document_count, first + part_size, segment_end - first_ordinal });
+        BatchPart& part = parts.emplace_back();
+        part.first_document = first;
+        part.last_document = last;
+        part.index.first_ordinal = static_cast<DocumentOrdinal>(first_ordinal + first);
+        part.index.last_ordinal = static_cast<DocumentOrdinal>(first_ordinal + last);
+        if (first_ordinal + last == segment_end)
+        {
+            segment_end += segment_document_count_;
         }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
+        first = last;
+    }
+    return parts;
+}
+
+// exceptions must not leave a task of a parallel algorithm, the first one is kept for the caller instead
+void SearchServer::InvertBatchPart(const vector<DocumentInput>& documents, BatchPart& part) const
+{
+    try
+    {
+        unordered_map<string_view, TermId> word_ids;
+        vector<string_view> words;
+        vector<TermId> document_word_ids;
+        part.word_freqs.resize(part.last_document - part.first_document);
+        part.document_lengths.reserve(part.last_document - part.first_document);
+        for (size_t document = part.first_document; document < part.last_document; ++document)
+        {
+            SplitIntoWordsNoStopView(documents[document].text, words);
+            document_word_ids.resize(words.size());
+            transform(words.begin(), words.end(), document_word_ids.begin(), [&](string_view word)
+                {
+                    const auto [position, is_new] = word_ids.emplace(word, static_cast<TermId>(part.words.size()));
+                    if (is_new) {
+                        part.words.push_back(word);
+                    }
+                    return position->second;
+                });
+            sort(document_word_ids.begin(), document_word_ids.end());
+
+            const double inv_word_count = 1.0 / words.size();
+            auto& word_freqs = part.word_freqs[document - part.first_document];
+            for (size_t start = 0, end = 0; start < document_word_ids.size(); start = end) {
+                while (end < document_word_ids.size() && document_word_ids[end] == document_word_ids[start]) {
+                    ++end;
+                }
+                word_freqs.push_back({ document_word_ids[start], (end - start) * inv_word_count });
+            }
+            part.document_lengths.push_back(static_cast<uint32_t>(words.size()));
+        }
+
+        // postings are grouped by word with a counting sort, documents are visited in order
+        // so the ordinals of every word stay ascending
+        PartialIndex& index = part.index;
+        index.offsets.assign(part.words.size() + 1, 0);
+        for (const auto& word_freqs : part.word_freqs)
+        {
+            for (const auto& [word, term_freq] : word_freqs)
+            {
+                ++index.offsets[word + 1];
+            }
+        }
+        partial_sum(index.offsets.begin(), index.offsets.end(), index.offsets.begin());
+        index.ordinals.resize(index.offsets.back());
+        index.term_freqs.resize(index.offsets.back());
+        vector<size_t> next_postings(index.offsets.begin(), index.offsets.end() - 1);
+        for (size_t document = 0; document < part.word_freqs.size(); ++document)
+        {
+            for (const auto& [word, term_freq] : part.word_freqs[document])
+            {
+                const size_t posting = next_postings[word]++;
+                index.ordinals[posting] = index.first_ordinal + static_cast<DocumentOrdinal>(document);
+                index.term_freqs[posting] = term_freq;
+            }
+        }
+    }
+    catch (...)
+    {
+        part.error = current_exception();
+    }
+}
+
+// words are interned in the order they first occur, so ids come out as if the documents were added one by one
+void SearchServer::InternBatchPart(BatchPart& part)
+{
+    part.index.words.resize(part.words.size());
+    transform(part.words.begin(), part.words.end(), part.index.words.begin(), [this](string_view word)
+        {
+            return term_dictionary_.Insert(word);
+        });
+}
+
+void SearchServer::RemapBatchPart(const vector<DocumentInput>& documents, BatchPart& part) const
+{
+    for (size_t document = part.first_document; document < part.last_document; ++document)
+    {
+        auto& word_freqs = part.word_freqs[document - part.first_document];
+        for (auto& [word, term_freq] : word_freqs)
+        {
+            word = part.index.words[word];
+        }
+        sort(word_freqs.begin(), word_freqs.end());
+        if (has_min_hash_sketches_)
+        {
+            part.min_hash_sketches.push_back(ComputeMinHashSketch(word_freqs));
+        }
+        if (has_word_positions_)
+        {
+            part.word_positions.AddDocument(word_freqs.size(), FindWordPositions(documents[document].text, word_freqs));
+        }
+    }
+}
+
+void SearchServer::AddBatchParts(const vector<DocumentInput>& documents, vector<BatchPart>& parts)
+{
+    query_cache_.Invalidate();
+    document_freqs_.resize(term_dictionary_.size());
+    inverse_document_freqs_.Invalidate(term_dictionary_.size());
+    for (BatchPart& part : parts)
+    {
+        const PartialIndex& index = part.index;
+        for (size_t i = 0; i < index.words.size(); ++i)
+        {
+            document_freqs_[index.words[i]] += static_cast<uint32_t>(index.offsets[i + 1] - index.offsets[i]);
+        }
+        mutable_segment_.Append(index);
+        if (has_word_positions_)
+        {
+            word_positions_.Append(part.word_positions);
+        }
+
+        for (size_t document = part.first_document; document < part.last_document; ++document)
+        {
+            const DocumentInput& input = documents[document];
+            const size_t part_document = document - part.first_document;
+            const DocumentOrdinal ordinal = index.first_ordinal + static_cast<DocumentOrdinal>(part_document);
+            const auto& word_freqs = part.word_freqs[part_document];
+            word_freqs_.insert(word_freqs_.end(), word_freqs.begin(), word_freqs.end());
+            word_freq_offsets_.push_back(word_freqs_.size());
+            document_ordinals_.emplace(input.id, ordinal);
+            ordinal_to_document_id_.push_back(input.id);
+            document_lengths_.push_back(part.document_lengths[part_document]);
+            document_ratings_.push_back(ComputeAverageRating(input.ratings));
+            document_statuses_.push_back(input.status);
+            status_ordinals_[static_cast<size_t>(input.status)].Add(ordinal);
+            rating_ordinals_[document_ratings_.back()].Add(ordinal);
+            total_document_length_ += part.document_lengths[part_document];
+            if (has_min_hash_sketches_)
+            {
+                min_hash_sketches_.push_back(part.min_hash_sketches[part_document]);
+            }
+            document_ids_.insert(input.id);
+        }
+
+        if (mutable_segment_.GetLastOrdinal() - mutable_segment_.GetFirstOrdinal() >= segment_document_count_) {
+            FreezeMutableSegment();
         }
     }
-    return words;
 }
 
 int SearchServer::ComputeAverageRating(const vector<int>& ratings)
@@ -142,6 +1160,43 @@ int SearchServer::ComputeAverageRating(const vector<int>& ratings)
     return rating_sum / static_cast<int>(ratings.size());
 }
 
+ScoreAccumulator& SearchServer::GetThreadScoreAccumulator()
+{
+    thread_local ScoreAccumulator accumulator;
+    return accumulator;
+}
+
+bool SearchServer::IsMoreRelevant(const Document& lhs, const Document& rhs)
+{
+    if (std::abs(lhs.relevance - rhs.relevance) >= MAX_DIFF) {
+        return lhs.relevance > rhs.relevance;
+    }
+    if (lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.id < rhs.id;
+}
+
+void SearchServer::PushTopDocument(vector<Document>& top_documents, const Document& document, size_t top_count)
+{
+    if (top_documents.size() < top_count) {
+        top_documents.push_back(document);
+        push_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+    }
+    else if (top_count > 0 && IsMoreRelevant(document, top_documents.front())) {
+        pop_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+        top_documents.back() = document;
+        push_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+    }
+}
+
+void SearchServer::SelectTopDocuments(vector<Document>& documents) const
+{
+    const size_t top_count = min(documents.size(), max_result_document_count_);
+    partial_sort(documents.begin(), documents.begin() + top_count, documents.end(), IsMoreRelevant);
+    documents.resize(top_count);
+}
+
 SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
     if (text.empty()) {
         throw std::invalid_argument("Query word is empty"s);
@@ -152,47 +1207,521 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
         is_minus = true;
         word = word.substr(1);
     }
+    // a lone * has no prefix to expand and is the word itself
+    const bool is_prefix = word.size() > 1 && word.back() == '*';
+    if (is_prefix) {
+        word.remove_suffix(1);
+    }
     if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
         throw std::invalid_argument("Query word "s + string(text) + " is invalid");
     }
 
-    return { word, is_minus, IsStopWord(word) };
+    return { word, is_minus, !is_prefix && IsStopWord(word), is_prefix };
 }
 
-void SearchServer::Deduplicator(std::vector<std::string_view>& vec) const
+void SearchServer::Deduplicator(std::vector<TermId>& vec) const
 {
     std::sort(vec.begin(), vec.end());
     auto erase_iterator = std::unique(vec.begin(), vec.end());
     vec.erase(erase_iterator, vec.end());
 }
 
-SearchServer::Query SearchServer::ParseQuery(string_view text, bool parallel_policy) const
+SearchServer::Query SearchServer::ParseQuery(string_view text) const
 {
     Query result;
-    for (string_view word : SplitIntoWordsView(text)) {
-        const auto query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                result.minus_words.push_back(query_word.data);
+    ParseQuery(text, result);
+    return result;
+}
+
+void SearchServer::ParseQuery(string_view text, Query& result) const
+{
+    result.plus_words.clear();
+    result.minus_words.clear();
+    result.phrases.clear();
+    result.typo_words.clear();
+    // the words are only looked at during parsing
+    thread_local vector<string_view> words;
+    SplitIntoWordsView(text, words);
+    for (size_t i = 0; i < words.size(); ++i) {
+        if (words[i][0] == '"') {
+            i = ParsePhrase(words, i, result);
+            continue;
+        }
+        const auto query_word = ParseQueryWord(words[i]);
+        if (query_word.is_stop) {
+            continue;
+        }
+        if (query_word.is_prefix) {
+            // words left only in removed documents are skipped, they would take expansions and match nothing
+            vector<TermId>& prefix_words = query_word.is_minus ? result.minus_words : result.plus_words;
+            size_t expansion_count = 0;
+            term_dictionary_.ForEachWithPrefix(query_word.data, [&](TermId word) {
+                if (expansion_count == max_prefix_expansions_) {
+                    return false;
+                }
+                if (document_freqs_[word] > 0) {
+                    prefix_words.push_back(word);
+                    ++expansion_count;
+                }
+                return true;
+                });
+            continue;
+        }
+        const TermId word_id = term_dictionary_.Find(query_word.data);
+        if (!query_word.is_minus && typo_distance_ > 0 && (word_id == NO_TERM || document_freqs_[word_id] == 0)) {
+            AddTypoWords(query_word.data, result);
+            continue;
+        }
+        if (word_id == NO_TERM) {
+            continue;
+        }
+        if (query_word.is_minus) {
+            result.minus_words.push_back(word_id);
+        }
+        else {
+            result.plus_words.push_back(word_id);
+        }
+    }
+
+    if (!result.typo_words.empty()) {
+        // a word the query has as it is counts in full
+        Deduplicator(result.typo_words);
+        vector<TermId> exact_words = result.plus_words;
+        Deduplicator(exact_words);
+        result.typo_words.erase(remove_if(result.typo_words.begin(), result.typo_words.end(), [&](TermId word) {
+            return binary_search(exact_words.begin(), exact_words.end(), word);
+            }), result.typo_words.end());
+        result.plus_words.insert(result.plus_words.end(), result.typo_words.begin(), result.typo_words.end());
+    }
+
+    Deduplicator(result.plus_words);
+    Deduplicator(result.minus_words);
+    sort(result.phrases.begin(), result.phrases.end());
+    result.phrases.erase(unique(result.phrases.begin(), result.phrases.end()), result.phrases.end());
+}
+
+void SearchServer::AddTypoWords(string_view word, Query& query) const
+{
+    vector<pair<TermId, uint32_t>> candidates = term_dictionary_.FindWithinDistance(word, typo_distance_);
+    candidates.erase(remove_if(candidates.begin(), candidates.end(), [this](const pair<TermId, uint32_t>& candidate) {
+        return document_freqs_[candidate.first] == 0;
+        }), candidates.end());
+    sort(candidates.begin(), candidates.end(), [this](const pair<TermId, uint32_t>& lhs, const pair<TermId, uint32_t>& rhs) {
+        return make_tuple(lhs.second, document_freqs_[rhs.first], lhs.first)
+            < make_tuple(rhs.second, document_freqs_[lhs.first], rhs.first);
+        });
+    candidates.resize(min(candidates.size(), MAX_TYPO_EXPANSIONS));
+    for (const auto& [candidate, distance] : candidates) {
+        query.typo_words.push_back(candidate);
+    }
+}
+
+size_t SearchServer::ParsePhrase(const vector<string_view>& words, size_t first, Query& query) const
+{
+    Phrase phrase;
+    uint32_t offset = 0;
+    for (size_t i = first; i < words.size(); ++i) {
+        string_view word = words[i];
+        if (i == first) {
+            word.remove_prefix(1);
+        }
+        const bool is_last = !word.empty() && word.back() == '"';
+        if (is_last) {
+            word.remove_suffix(1);
+        }
+        if (!word.empty()) {
+            if (word[0] == '-' || word.find('"') != string_view::npos || !IsValidWord(word)) {
+                throw invalid_argument("Phrase word "s + string(words[i]) + " is invalid"s);
+            }
+            if (!IsStopWord(word)) {
+                const TermId word_id = term_dictionary_.Find(word);
+                phrase.words.push_back(word_id);
+                phrase.offsets.push_back(offset);
+                if (word_id != NO_TERM) {
+                    query.plus_words.push_back(word_id);
+                }
+            }
+            ++offset;
+        }
+        if (is_last) {
+            // without positions the words of a phrase are only plus words
+            if (has_word_positions_ && !phrase.words.empty()) {
+                query.phrases.push_back(move(phrase));
+            }
+            return i;
+        }
+    }
+    throw invalid_argument("Phrase is not closed"s);
+}
+
+vector<pair<uint32_t, uint32_t>> SearchServer::FindWordPositions(string_view text,
+    TermFrequencies word_freqs) const
+{
+    // stop words take positions too, the text is valid already
+    const vector<string_view> words = SplitIntoWordsView(text);
+    vector<pair<uint32_t, uint32_t>> word_positions;
+    word_positions.reserve(words.size());
+    for (uint32_t position = 0; position < words.size(); ++position) {
+        if (IsStopWord(words[position])) {
+            continue;
+        }
+        const TermId word = term_dictionary_.Find(words[position]);
+        const auto word_freq = lower_bound(word_freqs.begin(), word_freqs.end(), word,
+            [](const pair<TermId, double>& word_freq, TermId word) {
+                return word_freq.first < word;
+            });
+        word_positions.push_back({ static_cast<uint32_t>(word_freq - word_freqs.begin()), position });
+    }
+    sort(word_positions.begin(), word_positions.end());
+    return word_positions;
+}
+
+bool SearchServer::ContainsPhrases(const vector<Phrase>& phrases, DocumentOrdinal ordinal) const
+{
+    const TermFrequencies word_freqs = GetOrdinalTermFrequencies(ordinal);
+    vector<size_t> document_words;
+    vector<uint32_t> first_positions;
+    vector<uint32_t> positions;
+    for (const Phrase& phrase : phrases) {
+        document_words.clear();
+        for (const TermId word : phrase.words) {
+            const auto word_freq = lower_bound(word_freqs.begin(), word_freqs.end(), word,
+                [](const pair<TermId, double>& word_freq, TermId word) {
+                    return word_freq.first < word;
+                });
+            if (word_freq == word_freqs.end() || word_freq->first != word) {
+                return false;
+            }
+            document_words.push_back(word_freq - word_freqs.begin());
+        }
+
+        // starts of the phrase left after every word, kept relative to the first word
+        word_positions_.GetPositions(ordinal, document_words[0], first_positions);
+        for (size_t i = 1; i < phrase.words.size() && !first_positions.empty(); ++i) {
+            word_positions_.GetPositions(ordinal, document_words[i], positions);
+            const uint32_t offset = phrase.offsets[i] - phrase.offsets[0];
+            first_positions.erase(remove_if(first_positions.begin(), first_positions.end(), [&](uint32_t start) {
+                return !binary_search(positions.begin(), positions.end(), start + offset);
+                }), first_positions.end());
+        }
+        if (first_positions.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const OrdinalBitmap* SearchServer::GetPredicateOrdinals(const OrdinalPredicate& document_predicate) const
+{
+    return document_predicate.ordinals;
+}
+
+bool SearchServer::IsDocumentAccepted(const Query& query, const OrdinalPredicate&, DocumentOrdinal ordinal) const
+{
+    return query.phrases.empty() || ContainsPhrases(query.phrases, ordinal);
+}
+
+const OrdinalBitmap* SearchServer::FindFilterOrdinals(const DocumentFilter& filter, OrdinalBitmap& ordinals) const
+{
+    array<bool, DOCUMENT_STATUS_COUNT> is_status_allowed = {};
+    for (const DocumentStatus status : filter.statuses) {
+        is_status_allowed[static_cast<size_t>(status)] = true;
+    }
+    size_t status_count = 0;
+    size_t status_size = 0;
+    for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+        if (is_status_allowed[status]) {
+            ++status_count;
+            status_size += status_ordinals_[status].size();
+        }
+    }
+
+    const bool is_rating_empty = filter.min_rating > filter.max_rating;
+    const auto first_rating = rating_ordinals_.lower_bound(filter.min_rating);
+    const auto last_rating = is_rating_empty ? first_rating : rating_ordinals_.upper_bound(filter.max_rating);
+    const bool is_rating_bounded = first_rating != rating_ordinals_.begin() || last_rating != rating_ordinals_.end();
+    const bool is_id_empty = filter.min_document_id > filter.max_document_id;
+    const auto first_document = document_ids_.lower_bound(filter.min_document_id);
+    const auto last_document = is_id_empty ? first_document : document_ids_.upper_bound(filter.max_document_id);
+    const bool is_id_bounded = first_document != document_ids_.begin() || last_document != document_ids_.end();
+    if (status_count == 1 && !is_rating_bounded && !is_id_bounded) {
+        const auto status = find(is_status_allowed.begin(), is_status_allowed.end(), true) - is_status_allowed.begin();
+        return &status_ordinals_[status];
+    }
+
+    size_t rating_size = 0;
+    for (auto rating = first_rating; rating != last_rating && is_rating_bounded; ++rating) {
+        rating_size += rating->second.size();
+    }
+    if (!is_rating_bounded) {
+        rating_size = document_ids_.size();
+    }
+    // the documents of the id range are only counted as far as they could be the fewest
+    const size_t walk_limit = min(status_size, rating_size);
+    size_t id_size = is_id_bounded ? 0 : document_ids_.size() + 1;
+    for (auto document = first_document; document != last_document && id_size <= walk_limit; ++document) {
+        ++id_size;
+    }
+
+    const auto is_status_passed = [&](DocumentOrdinal ordinal) {
+        for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+            if (is_status_allowed[status] && status_ordinals_[status].Contains(ordinal)) {
+                return true;
             }
-            else {
-                result.plus_words.push_back(query_word.data);
+        }
+        return false;
+    };
+    const auto is_rating_passed = [&](int rating) {
+        return rating >= filter.min_rating && rating <= filter.max_rating;
+    };
+    const auto is_id_passed = [&](int document_id) {
+        return document_id >= filter.min_document_id && document_id <= filter.max_document_id;
+    };
+
+    if (id_size <= walk_limit) {
+        vector<DocumentOrdinal> passed_ordinals;
+        for (auto document = first_document; document != last_document; ++document) {
+            const DocumentOrdinal ordinal = document_ordinals_.at(*document);
+            if (is_status_allowed[static_cast<size_t>(document_statuses_[ordinal])]
+                && is_rating_passed(document_ratings_[ordinal])) {
+                passed_ordinals.push_back(ordinal);
             }
         }
+        // a bitmap is filled fastest in increasing order
+        sort(passed_ordinals.begin(), passed_ordinals.end());
+        for (const DocumentOrdinal ordinal : passed_ordinals) {
+            ordinals.Add(ordinal);
+        }
+        // the set lives for one query and is probed for every posting, so its chunks do not need to be small
+        ordinals.ConvertToBitmaps();
+        return &ordinals;
     }
 
-    if (parallel_policy == 0)
+    // every walked bitmap yields its passed ordinals in increasing order, they are merged chunk by chunk,
+    // and a bitmap nothing else restricts is merged as is
+    const auto add_passed = [&ordinals](const OrdinalBitmap& walked, bool is_checked, auto is_passed) {
+        if (!is_checked) {
+            ordinals.UnionWith(walked);
+            return;
+        }
+        OrdinalBitmap passed;
+        walked.ForEach([&passed, &is_passed](DocumentOrdinal ordinal) {
+            if (is_passed(ordinal)) {
+                passed.Add(ordinal);
+            }
+            });
+        ordinals.UnionWith(passed);
+    };
+    if (rating_size < status_size) {
+        const bool is_checked = status_count < DOCUMENT_STATUS_COUNT || is_id_bounded;
+        for (auto rating = first_rating; rating != last_rating; ++rating) {
+            add_passed(rating->second, is_checked, [&](DocumentOrdinal ordinal) {
+                return is_status_passed(ordinal) && (!is_id_bounded || is_id_passed(ordinal_to_document_id_[ordinal]));
+                });
+        }
+    }
+    else {
+        const bool is_checked = is_rating_bounded || is_id_bounded;
+        for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+            if (!is_status_allowed[status]) {
+                continue;
+            }
+            add_passed(status_ordinals_[status], is_checked, [&](DocumentOrdinal ordinal) {
+                return (!is_id_bounded || is_id_passed(ordinal_to_document_id_[ordinal]))
+                    && (!is_rating_bounded || is_rating_passed(document_ratings_[ordinal]));
+                });
+        }
+    }
+    ordinals.ConvertToBitmaps();
+    return &ordinals;
+}
+
+double SearchServer::ComputeWordInverseDocumentFreq(TermId word) const
+{
+    return inverse_document_freqs_.Get(word, [this, word]() {
+        return scoring_model_ == ScoringModel::BM25
+            ? Bm25Model::ComputeInverseDocumentFreq(document_ordinals_.size(), document_freqs_[word])
+            : TfIdfModel::ComputeInverseDocumentFreq(document_ordinals_.size(), document_freqs_[word]);
+        });
+}
+
+double SearchServer::ComputeQueryWordWeight(const Query& query, TermId word) const
+{
+    if (document_freqs_[word] == 0) {
+        return 0.0;
+    }
+    const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
+    return binary_search(query.typo_words.begin(), query.typo_words.end(), word)
+        ? inverse_document_freq * typo_penalty_ : inverse_document_freq;
+}
+
+vector<const IndexSegment*> SearchServer::GetSegments() const
+{
+    vector<const IndexSegment*> segments;
+    segments.reserve(frozen_segments_.size() + 1);
+    for (const FrozenSegment& segment : frozen_segments_)
     {
-        Deduplicator(result.plus_words);
-        Deduplicator(result.minus_words);
+        segments.push_back(segment.index.get());
     }
+    segments.push_back(&mutable_segment_);
+    return segments;
+}
 
-    return result;
+vector<SearchServer::SegmentRange> SearchServer::SplitSegments(size_t part_count) const
+{
+    const size_t range_size = max<size_t>(1, (ordinal_to_document_id_.size() + part_count - 1) / part_count);
+    vector<SegmentRange> ranges;
+    for (const IndexSegment* segment : GetSegments())
+    {
+        for (size_t first = segment->GetFirstOrdinal(); first < segment->GetLastOrdinal(); first += range_size)
+        {
+            ranges.push_back({ segment, static_cast<DocumentOrdinal>(first),
+                static_cast<DocumentOrdinal>(min<size_t>(first + range_size, segment->GetLastOrdinal())) });
+        }
+    }
+    return ranges;
+}
+
+size_t SearchServer::FindFrozenSegment(DocumentOrdinal ordinal) const
+{
+    return upper_bound(frozen_segments_.begin(), frozen_segments_.end(), ordinal,
+        [](DocumentOrdinal lhs, const FrozenSegment& rhs) {
+            return lhs < rhs.index->GetLastOrdinal();
+        }) - frozen_segments_.begin();
+}
+
+vector<bool> SearchServer::GetRemovedOrdinals(DocumentOrdinal first_ordinal, DocumentOrdinal last_ordinal) const
+{
+    vector<bool> is_removed(last_ordinal - first_ordinal);
+    for (DocumentOrdinal ordinal = first_ordinal; ordinal < last_ordinal; ++ordinal)
+    {
+        is_removed[ordinal - first_ordinal] = ordinal_to_document_id_[ordinal] == NO_DOCUMENT_ID;
+    }
+    return is_removed;
+}
+
+// tombstones of the mutable segment are dropped here, before anything else reads it
+void SearchServer::FreezeMutableSegment()
+{
+    const DocumentOrdinal first_ordinal = mutable_segment_.GetFirstOrdinal();
+    const DocumentOrdinal last_ordinal = mutable_segment_.GetLastOrdinal();
+    const vector<bool> is_removed = GetRemovedOrdinals(first_ordinal, last_ordinal);
+    if (find(is_removed.begin(), is_removed.end(), true) != is_removed.end())
+    {
+        const vector<uint32_t> document_lengths(document_lengths_.begin() + first_ordinal,
+            document_lengths_.begin() + last_ordinal);
+        mutable_segment_ = IndexSegment::Merge({ &mutable_segment_ }, is_removed, segment_encoding_, document_lengths);
+    }
+    else
+    {
+        mutable_segment_.Compact(segment_encoding_, document_lengths_, 0);
+    }
+    frozen_segments_.push_back({ make_shared<const IndexSegment>(move(mutable_segment_)), 0 });
+    mutable_segment_ = IndexSegment(last_ordinal);
+    StartMerge();
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(string_view word) const
+// SEGMENT_MERGE_FACTOR neighbouring segments of the same size class are merged into one of the next class,
+// otherwise a segment with more removed documents than live ones is rewritten alone
+void SearchServer::StartMerge()
 {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+    if (pending_merge_.valid())
+    {
+        return;
+    }
+
+    auto get_size_class = [this](size_t segment)
+    {
+        const FrozenSegment& frozen = frozen_segments_[segment];
+        size_t size_class = 0;
+        for (size_t size = segment_document_count_ * SEGMENT_MERGE_FACTOR;
+            size <= frozen.index->GetDocumentCount() - frozen.removed_document_count; size *= SEGMENT_MERGE_FACTOR)
+        {
+            ++size_class;
+        }
+        return size_class;
+    };
+
+    size_t first_segment = 0;
+    size_t last_segment = 0;
+    for (size_t end = frozen_segments_.size(); end > 0 && last_segment == 0;)
+    {
+        size_t begin = end - 1;
+        while (begin > 0 && get_size_class(begin - 1) == get_size_class(end - 1))
+        {
+            --begin;
+        }
+        // the oldest ones, so that the rest stays next to the newer segments of its class and is merged with them
+        if (end - begin >= SEGMENT_MERGE_FACTOR)
+        {
+            first_segment = begin;
+            last_segment = begin + SEGMENT_MERGE_FACTOR;
+        }
+        end = begin;
+    }
+    for (size_t segment = 0; segment < frozen_segments_.size() && last_segment == 0; ++segment)
+    {
+        const FrozenSegment& frozen = frozen_segments_[segment];
+        if (frozen.removed_document_count * 2 > frozen.index->GetDocumentCount())
+        {
+            first_segment = segment;
+            last_segment = segment + 1;
+        }
+    }
+    if (last_segment == 0)
+    {
+        return;
+    }
+
+    vector<shared_ptr<const IndexSegment>> segments;
+    merge_removed_document_count_ = 0;
+    for (size_t segment = first_segment; segment < last_segment; ++segment)
+    {
+        segments.push_back(frozen_segments_[segment].index);
+        merge_removed_document_count_ += frozen_segments_[segment].removed_document_count;
+    }
+    const DocumentOrdinal first_ordinal = segments.front()->GetFirstOrdinal();
+    const DocumentOrdinal last_ordinal = segments.back()->GetLastOrdinal();
+    vector<uint32_t> document_lengths;
+    if (segment_encoding_ == PostingEncoding::COMPRESSED)
+    {
+        document_lengths.assign(document_lengths_.begin() + first_ordinal, document_lengths_.begin() + last_ordinal);
+    }
+
+    // the task gets copies of everything it reads, the server keeps changing while it runs
+    merge_first_segment_ = first_segment;
+    merge_last_segment_ = last_segment;
+    auto merge = [segments, is_removed = GetRemovedOrdinals(first_ordinal, last_ordinal),
+        encoding = segment_encoding_, document_lengths = move(document_lengths), snapshot_file = snapshot_file_]()
+        {
+            vector<const IndexSegment*> merged_segments;
+            for (const auto& segment : segments)
+            {
+                merged_segments.push_back(segment.get());
+            }
+            return make_shared<const IndexSegment>(IndexSegment::Merge(merged_segments, is_removed, encoding, document_lengths));
+        };
+    pending_merge_ = thread_pool_ ? thread_pool_->Submit(move(merge), TaskPriority::LOW) : async(launch::async, move(merge));
+}
+
+void SearchServer::FinishMerge(bool wait)
+{
+    if (!pending_merge_.valid()
+        || (!wait && pending_merge_.wait_for(chrono::seconds(0)) != future_status::ready))
+    {
+        return;
+    }
+
+    shared_ptr<const IndexSegment> merged = pending_merge_.get();
+    size_t removed_document_count = 0;
+    for (size_t segment = merge_first_segment_; segment < merge_last_segment_; ++segment)
+    {
+        removed_document_count += frozen_segments_[segment].removed_document_count;
+    }
+    frozen_segments_[merge_first_segment_] = { merged, removed_document_count - merge_removed_document_count_ };
+    frozen_segments_.erase(frozen_segments_.begin() + merge_first_segment_ + 1,
+        frozen_segments_.begin() + merge_last_segment_);
+    StartMerge();
 }
 
 void MatchDocument(const SearchServer& search_server, string_view raw_query, int document_id)
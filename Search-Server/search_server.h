@@ -1,16 +1,28 @@
 #pragma once
 
 #include "string_processing.h"
+#include "concurrent_lru_cache.h"
 #include "document.h"
+#include "index_segment.h"
 #include "log_duration.h"
-#include "concurrent_map.h"
+#include "min_hash.h"
+#include "ordinal_bitmap.h"
+#include "position_index.h"
+#include "posting_list.h"
+#include "score_accumulator.h"
+#include "scoring_model.h"
+#include "snapshot.h"
+#include "term_dictionary.h"
+#include "thread_pool.h"
 
 #include <algorithm>
+#include <array>
 #include <stdexcept>
 #include <vector>
 #include <algorithm>
 #include <map>
 #include <set>
+#include <unordered_map>
 #include <string>
 #include <cmath>
 #include <utility>
@@ -18,13 +30,42 @@
 #include <execution>
 #include <string_view>
 #include <functional>
+#include <thread>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <optional>
+#include <exception>
 
 using namespace std::literals::string_literals;
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 
+// words of the dictionary a query word like transp* stands for at most
+const size_t MAX_PREFIX_EXPANSIONS = 64;
+
+// typo tolerance finds words at most this many insertions, deletions or substitutions away
+const uint32_t MAX_TYPO_DISTANCE = 2;
+
+// words of the dictionary a misspelled query word stands for at most
+const size_t MAX_TYPO_EXPANSIONS = 8;
+
+const double TYPO_PENALTY = 0.5;
+
 const double MAX_DIFF = 1e-6;
 
+const size_t SEGMENT_DOCUMENT_COUNT = 4096;
+
+// number of frozen segments of one size class that are merged together
+const size_t SEGMENT_MERGE_FACTOR = 4;
+
+const int NO_DOCUMENT_ID = -1;
+
+// ordinals scored together by FindTopDocumentsBatch, bounds the postings buffered for all queries at once
+const size_t QUERY_BATCH_BLOCK_SIZE = 4096;
+
 enum class DocumentStatus
 {
     ACTUAL,
@@ -33,6 +74,37 @@ enum class DocumentStatus
     REMOVED,
 };
 
+enum class RetrievalStrategy
+{
+    EXHAUSTIVE,
+    MAX_SCORE,
+};
+
+struct DocumentInput
+{
+    int id;
+    std::string_view text;
+    DocumentStatus status;
+    std::vector<int> ratings;
+};
+
+// Documents FindTopDocuments may return, bounds are inclusive. The documents passing the filter are found
+// from indexes of statuses and ratings before any scoring, so the more selective a filter, the faster the query
+struct DocumentFilter
+{
+    std::vector<DocumentStatus> statuses = { DocumentStatus::ACTUAL };
+    int min_rating = std::numeric_limits<int>::min();
+    int max_rating = std::numeric_limits<int>::max();
+    int min_document_id = 0;
+    int max_document_id = std::numeric_limits<int>::max();
+};
+
+struct PruningStats
+{
+    uint64_t scored_postings = 0;
+    uint64_t skipped_postings = 0;
+};
+
 class SearchServer
 {
 
@@ -47,11 +119,62 @@ public:
     void AddDocument(int document_id, std::string_view document, DocumentStatus status,
         const std::vector<int>& ratings);
 
+    // Documents are tokenized and inverted in parallel parts, which are then merged into the index in one pass.
+    // If any of the documents is invalid, none of them is added
+    template <typename ExecutionPolicy>
+    void AddDocuments(ExecutionPolicy&& policy, const std::vector<DocumentInput>& documents);
+
+    void AddDocuments(const std::vector<DocumentInput>& documents);
+
     template<class ExecutionPolicy>
     void RemoveDocument(ExecutionPolicy&& policy, int document_id);
 
+    // Removed documents stay in the posting lists as tombstones: queries skip their ordinals and IDF counts
+    // only live documents. Freezing the mutable segment and merges drop their postings, CompactIndex drops all of them.
+    // An unknown id throws std::out_of_range, as it always did
     void RemoveDocument(int document_id);
 
+    // removes nothing and throws std::out_of_range if some id is unknown, an id given twice is removed once
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    void CompactIndex(PostingEncoding encoding = PostingEncoding::PLAIN);
+
+    // Memory of the segments, the forward index of term frequencies, the per-document arrays and bitmaps,
+    // sketches and positions. The term dictionary and the id lookups are left out
+    size_t GetIndexMemoryUsage() const;
+
+    // New documents go to a small mutable segment, which is frozen once it holds this many documents.
+    // Frozen segments are merged in the background, merges also drop the postings of removed documents
+    void SetSegmentDocumentCount(size_t count);
+
+    size_t GetSegmentCount() const;
+
+    // blocks until no merge is running and every finished one is in use
+    void WaitForMerges();
+
+    // MinHash sketches of all documents for near-duplicate detection, kept up to date as documents are added.
+    // They take MIN_HASH_COUNT * 4 bytes per document, so they are off by default
+    void SetMinHashSketches(bool enabled);
+
+    bool HasMinHashSketches() const;
+
+    const MinHashSketch& GetMinHashSketch(int document_id) const;
+
+    // Word positions for phrase queries: words in double quotes, like "new york", only match documents where
+    // they stand in this order next to each other, stop words keep their places. Positions are taken from
+    // the text of a document, so they have to be turned on before the first document is added.
+    // Without positions the words in quotes are ordinary plus words
+    void SetWordPositions(bool enabled);
+
+    bool HasWordPositions() const;
+
+    // Writes the server to a versioned binary file. The file is replaced only once it has been written completely
+    void SaveSnapshot(const std::string& path) const;
+
+    // Maps a file written by SaveSnapshot read-only: the term dictionary and postings are used in place,
+    // only per-document data is read into memory. The file must not be changed while the server uses it
+    static SearchServer OpenSnapshot(const std::string& path);
+
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(std::string_view raw_query,
         DocumentPredicate document_predicate) const;
@@ -60,6 +183,8 @@ public:
 
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter) const;
+
     template <typename DocumentPredicate, typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
         DocumentPredicate document_predicate) const;
@@ -70,11 +195,80 @@ public:
     template<typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query) const;
 
+    template<typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+        const DocumentFilter& filter) const;
+
+    // Answers many queries together: every posting list is read once for all queries containing its word.
+    // Results are the same as those of FindTopDocuments(raw_query, status) for every query, ties included,
+    // so both share the cache
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string>& raw_queries,
+        DocumentStatus status = DocumentStatus::ACTUAL) const;
+
 
     int GetDocumentCount() const;
 
+    void SetMaxResultDocumentCount(size_t count);
+
+    size_t GetMaxResultDocumentCount() const;
+
+    // A query word ending with * stands for the words of the documents starting with it, the first ones
+    // in lexicographic order up to this count. A minus prefix excludes the same words. A lone * is an ordinary word
+    void SetMaxPrefixExpansions(size_t count);
+
+    size_t GetMaxPrefixExpansions() const;
+
+    // A plus word found in no document stands for the closest words within max_distance edits, the most frequent
+    // first, up to MAX_TYPO_EXPANSIONS of them. Words of phrases are never replaced. 0 turns typo tolerance off
+    void SetTypoTolerance(uint32_t max_distance);
+
+    uint32_t GetTypoTolerance() const;
+
+    // the relevance a word found in place of a misspelled one adds is multiplied by penalty, from 0 to 1
+    void SetTypoPenalty(double penalty);
+
+    double GetTypoPenalty() const;
+
+    void SetRetrievalStrategy(RetrievalStrategy strategy);
+
+    RetrievalStrategy GetRetrievalStrategy() const;
+
+    // TF-IDF by default. BM25 stops counting repeats of a word after a while and scores words of short documents
+    // above those of long ones, k1 and b of SetBm25Parameters tune both
+    void SetScoringModel(ScoringModel model);
+
+    ScoringModel GetScoringModel() const;
+
+    void SetBm25Parameters(const Bm25Parameters& parameters);
+
+    const Bm25Parameters& GetBm25Parameters() const;
+
+    // Postings scored and passed over by all queries so far. MaxScore passes over postings that cannot reach
+    // the top documents, every strategy passes over those of documents a status or DocumentFilter rejects
+    PruningStats GetPruningStats() const;
+
+    // Results of FindTopDocuments by status are cached for the set of query words, whatever their order and repeats.
+    // Any change of the documents invalidates the whole cache at once. A capacity of 0 turns the cache off
+    void SetQueryCacheCapacity(size_t capacity);
+
+    CacheStats GetQueryCacheStats() const;
+
+    // Calls with std::execution::par or par_unseq, batch queries and background merges run on this pool instead of
+    // the threads of the standard library. Ingestion and merges take low priority, queries high. nullptr drops the pool
+    void SetThreadPool(std::shared_ptr<ThreadPool> thread_pool);
+
+    const std::shared_ptr<ThreadPool>& GetThreadPool() const;
+
+    // The map is built on the first call for a document and kept until the document is removed.
+    // GetTermFrequencies gives the same frequencies without building anything
     const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
 
+    // the same frequencies by term id, sorted by id. Empty for an unknown document,
+    // valid until the documents of the server change
+    TermFrequencies GetTermFrequencies(int document_id) const;
+
+    std::vector<PostingBlock> GetPostingBlocks(std::string_view word) const;
+
     using SetIterator = std::set<int>::const_iterator;
 
     SetIterator begin() const;
@@ -85,28 +279,178 @@ public:
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query,
         int document_id) const;
 
+    // the same with the matched words put into matched_words, so that a caller matching many documents reuses
+    // its storage. Nothing is allocated once the buffers have grown, unless the query has phrases or misspellings
+    DocumentStatus MatchDocument(std::string_view raw_query, int document_id,
+        std::vector<std::string_view>& matched_words) const;
+
     template<class ExecutionPolicy>
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(ExecutionPolicy&& policy, std::string_view raw_query,
         int document_id) const;
 
 private:
-    struct DocumentData {
-        int rating;
+    struct FrozenSegment {
+        std::shared_ptr<const IndexSegment> index;
+        // documents removed after the segment was frozen, their postings stay until the next merge
+        size_t removed_document_count;
+    };
+
+    // documents [first_document, last_document) of a batch, inverted with term ids of the part itself
+    // until InternBatchPart puts the ids of the dictionary in index.words
+    struct BatchPart {
+        size_t first_document;
+        size_t last_document;
+        std::vector<std::string_view> words;
+        std::vector<std::vector<std::pair<TermId, double>>> word_freqs;
+        std::vector<uint32_t> document_lengths;
+        std::vector<MinHashSketch> min_hash_sketches;
+        PositionIndex word_positions;
+        PartialIndex index;
+        std::exception_ptr error;
+    };
+
+    struct SegmentRange {
+        const IndexSegment* segment;
+        DocumentOrdinal first_ordinal;
+        DocumentOrdinal last_ordinal;
+    };
+
+    // consecutive words of a quoted phrase, offsets count the skipped stop words too.
+    // A word missing from the dictionary stays as NO_TERM, such a phrase matches nothing
+    struct Phrase {
+        std::vector<TermId> words;
+        std::vector<uint32_t> offsets;
+
+        bool operator==(const Phrase& other) const;
+
+        bool operator<(const Phrase& other) const;
+    };
+
+    struct QueryCacheKey {
+        std::vector<TermId> plus_words;
+        std::vector<TermId> minus_words;
+        std::vector<Phrase> phrases;
+        std::vector<TermId> typo_words;
         DocumentStatus status;
+
+        bool operator==(const QueryCacheKey& other) const;
     };
 
-    std::set<std::string, std::less<>> word_collector_;
+    struct QueryCacheKeyHasher {
+        size_t operator()(const QueryCacheKey& key) const;
+    };
+
+    // the predicate of FindTopDocuments by status or by a DocumentFilter, the scoring loops answer it
+    // from the ordinals alone
+    struct OrdinalPredicate {
+        const OrdinalBitmap* ordinals;
+    };
+
+    static constexpr size_t DOCUMENT_STATUS_COUNT = static_cast<size_t>(DocumentStatus::REMOVED) + 1;
+
+    TermDictionary term_dictionary_;
     const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
-    std::map<int, DocumentData> documents_;
+    IndexSegment mutable_segment_;
+    std::vector<FrozenSegment> frozen_segments_;
+    std::vector<uint32_t> document_freqs_;
+    // of the live documents, the only lookup by external id
+    std::unordered_map<int, DocumentOrdinal> document_ordinals_;
+    // ids of the live documents in increasing order
     std::set<int> document_ids_;
+    // NO_DOCUMENT_ID for removed documents
+    std::vector<int> ordinal_to_document_id_;
+    // the rest of the metadata by ordinal, stale for removed documents
+    std::vector<uint32_t> document_lengths_;
+    std::vector<int> document_ratings_;
+    std::vector<DocumentStatus> document_statuses_;
+    // the term frequencies of a document are word_freqs_[word_freq_offsets_[ordinal], word_freq_offsets_[ordinal + 1]),
+    // those of removed documents are dropped once they take more than half of word_freqs_
+    std::vector<size_t> word_freq_offsets_ = std::vector<size_t>(1, 0);
+    std::vector<std::pair<TermId, double>> word_freqs_;
+    size_t removed_word_freq_count_ = 0;
+    // ordinals of the live documents by status
+    std::array<OrdinalBitmap, DOCUMENT_STATUS_COUNT> status_ordinals_;
+    // ordinals of the live documents by rating
+    std::map<int, OrdinalBitmap> rating_ordinals_;
+    // of the live documents
+    uint64_t total_document_length_ = 0;
+    // by ordinal, empty while sketches are off
+    std::vector<MinHashSketch> min_hash_sketches_;
+    bool has_min_hash_sketches_ = false;
+    // by ordinal, empty while positions are off
+    PositionIndex word_positions_;
+    bool has_word_positions_ = false;
+    size_t max_result_document_count_ = MAX_RESULT_DOCUMENT_COUNT;
+    size_t max_prefix_expansions_ = MAX_PREFIX_EXPANSIONS;
+    uint32_t typo_distance_ = 0;
+    double typo_penalty_ = TYPO_PENALTY;
+    RetrievalStrategy retrieval_strategy_ = RetrievalStrategy::EXHAUSTIVE;
+    ScoringModel scoring_model_ = ScoringModel::TF_IDF;
+    Bm25Parameters bm25_parameters_;
+    size_t segment_document_count_ = SEGMENT_DOCUMENT_COUNT;
+    PostingEncoding segment_encoding_ = PostingEncoding::PLAIN;
+    // scratch buffers of AddDocument, kept to avoid allocating for every document
+    std::vector<std::string_view> document_words_;
+    std::vector<TermId> document_word_ids_;
+    std::shared_ptr<const MappedFile> snapshot_file_;
+    // may be shared with other servers
+    std::shared_ptr<ThreadPool> thread_pool_;
+    // merge of frozen_segments_[merge_first_segment_, merge_last_segment_) running in the background
+    std::future<std::shared_ptr<const IndexSegment>> pending_merge_;
+    size_t merge_first_segment_ = 0;
+    size_t merge_last_segment_ = 0;
+    size_t merge_removed_document_count_ = 0;
+
+    struct PruningCounters {
+        PruningCounters() = default;
+        PruningCounters(const PruningCounters& other);
+
+        std::atomic<uint64_t> scored_postings = 0;
+        std::atomic<uint64_t> skipped_postings = 0;
+    };
+
+    mutable PruningCounters pruning_counters_;
+
+    // the maps GetWordFrequencies returns by document id
+    struct WordFrequencyMaps {
+        WordFrequencyMaps() = default;
+        // a copy starts empty
+        WordFrequencyMaps(const WordFrequencyMaps&);
+
+        std::mutex mutex;
+        std::unordered_map<int, std::map<std::string_view, double>> maps;
+    };
+
+    mutable WordFrequencyMaps word_frequency_maps_;
+    // of the current scoring model, invalidated whenever the documents change
+    mutable InverseDocumentFreqCache inverse_document_freqs_;
+    mutable ConcurrentLruCache<QueryCacheKey, std::vector<Document>, QueryCacheKeyHasher> query_cache_;
 
     bool IsStopWord(std::string_view word) const;
 
     static bool IsValidWord(std::string_view word);
 
-    std::vector<std::string_view> SplitIntoWordsNoStopView(std::string_view text) const;
+    void SplitIntoWordsNoStopView(std::string_view text, std::vector<std::string_view>& words) const;
+
+    void MarkDocumentRemoved(int document_id);
+
+    void CompactWordFreqs();
+
+    TermFrequencies GetOrdinalTermFrequencies(DocumentOrdinal ordinal) const;
+
+    void CheckNewDocumentIds(const std::vector<DocumentInput>& documents) const;
+
+    // about part_count parts, more where they would cross a border of the mutable segment,
+    // so that every part goes into a single segment
+    std::vector<BatchPart> SplitBatch(size_t document_count, size_t part_count) const;
+
+    void InvertBatchPart(const std::vector<DocumentInput>& documents, BatchPart& part) const;
+
+    void InternBatchPart(BatchPart& part);
+
+    void RemapBatchPart(const std::vector<DocumentInput>& documents, BatchPart& part) const;
+
+    void AddBatchParts(const std::vector<DocumentInput>& documents, std::vector<BatchPart>& parts);
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
@@ -114,30 +458,132 @@ private:
         std::string_view data;
         bool is_minus;
         bool is_stop;
+        bool is_prefix;
     };
 
     QueryWord ParseQueryWord(std::string_view text) const;
 
     struct Query {
-        std::vector<std::string_view> plus_words;
-        std::vector<std::string_view> minus_words;
+        std::vector<TermId> plus_words;
+        std::vector<TermId> minus_words;
+        // the words of phrases are plus words too
+        std::vector<Phrase> phrases;
+        // plus words standing for misspelled ones, sorted
+        std::vector<TermId> typo_words;
     };
 
-    Query ParseQuery(std::string_view text, bool parallel_policy = 0) const;
+    Query ParseQuery(std::string_view text) const;
 
+    // into the storage of result
+    void ParseQuery(std::string_view text, Query& result) const;
 
+    // words[first] opens a phrase, returns the index of the word closing it
+    size_t ParsePhrase(const std::vector<std::string_view>& words, size_t first, Query& query) const;
 
-    void Deduplicator(std::vector<std::string_view>& vec) const;
+    void AddTypoWords(std::string_view word, Query& query) const;
 
-    double ComputeWordInverseDocumentFreq(std::string_view word) const;
+    // (word, position) pairs of the document for word_positions_, words are indices in word_freqs
+    std::vector<std::pair<uint32_t, uint32_t>> FindWordPositions(std::string_view text,
+        TermFrequencies word_freqs) const;
 
+    // every word of a phrase has to be in the document before any position is decoded
+    bool ContainsPhrases(const std::vector<Phrase>& phrases, DocumentOrdinal ordinal) const;
+
+    // the only ordinals document_predicate may accept, nullptr when it has to be asked about every document
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query,
-        DocumentPredicate document_predicate) const;
+    const OrdinalBitmap* GetPredicateOrdinals(const DocumentPredicate& document_predicate) const;
+
+    const OrdinalBitmap* GetPredicateOrdinals(const OrdinalPredicate& document_predicate) const;
+
+    // document_predicate, then the phrases of the query. Only called for documents with an ordinal
+    // of GetPredicateOrdinals, which is all an OrdinalPredicate needs
+    template <typename DocumentPredicate>
+    bool IsDocumentAccepted(const Query& query, const DocumentPredicate& document_predicate, DocumentOrdinal ordinal) const;
+
+    bool IsDocumentAccepted(const Query& query, const OrdinalPredicate& document_predicate, DocumentOrdinal ordinal) const;
+
+    // Ordinals of the documents passing filter: the status bitmap itself for a filter by one status only,
+    // else the smallest of the sets by status, rating and id is walked into ordinals and the others are checked
+    const OrdinalBitmap* FindFilterOrdinals(const DocumentFilter& filter, OrdinalBitmap& ordinals) const;
+
+
+
+    void Deduplicator(std::vector<TermId>& vec) const;
+
+    double ComputeWordInverseDocumentFreq(TermId word) const;
+
+    // calls visit with the model of scoring_model_, so that every scoring loop is compiled for each model
+    template <typename Visitor>
+    auto VisitScoringModel(Visitor visit) const;
+
+    // the inverse document frequency of a plus word, lowered by the typo penalty for a word standing for a misspelled one
+    double ComputeQueryWordWeight(const Query& query, TermId word) const;
+
+    std::vector<const IndexSegment*> GetSegments() const;
+
+    // ranges of about ordinal_count / part_count ordinals, none of them crossing a segment border
+    std::vector<SegmentRange> SplitSegments(size_t part_count) const;
+
+    size_t FindFrozenSegment(DocumentOrdinal ordinal) const;
+
+    std::vector<bool> GetRemovedOrdinals(DocumentOrdinal first_ordinal, DocumentOrdinal last_ordinal) const;
+
+    void FreezeMutableSegment();
+
+    void StartMerge();
+
+    // puts a finished merge in place of its segments and looks for the next one
+    void FinishMerge(bool wait);
+
+    // number of parts parallel work with the policy is split into
+    template <typename ExecutionPolicy>
+    size_t GetParallelism(const ExecutionPolicy& policy) const;
+
+    // std::for_each(policy, ...), on thread_pool_ instead when it is set and the policy is a parallel standard one
+    template <typename ExecutionPolicy, typename Iterator, typename Function>
+    void ForEachInParallel(ExecutionPolicy&& policy, Iterator first, Iterator last, Function function,
+        TaskPriority priority = TaskPriority::HIGH) const;
+
+    // by relevance, then rating, then the lower id, so every way of searching orders ties the same
+    static bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+    // one per thread, its arrays grow to the largest range the thread has scored and are reused by every query
+    static ScoreAccumulator& GetThreadScoreAccumulator();
+
+    // top_documents is a heap with the least relevant of at most top_count documents at the front
+    static void PushTopDocument(std::vector<Document>& top_documents, const Document& document, size_t top_count);
+
+    std::vector<std::vector<Document>> FindTopDocumentsShared(const std::vector<const Query*>& queries,
+        DocumentStatus status) const;
+
+    void SelectTopDocuments(std::vector<Document>& documents) const;
+
+    template <typename ExecutionPolicy>
+    void SelectTopDocuments(ExecutionPolicy&& policy, std::vector<Document>& documents) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsForQuery(const Query& query, DocumentPredicate document_predicate) const;
 
     template <typename DocumentPredicate, typename ExecutionPolicy>
-    std::vector<Document> FindAllDocuments(ExecutionPolicy&& policy, const Query& query,
+    std::vector<Document> FindTopDocumentsForQuery(ExecutionPolicy&& policy, const Query& query,
         DocumentPredicate document_predicate) const;
+
+    // search() is only called on a cache miss
+    template <typename Search>
+    std::vector<Document> FindCachedTopDocuments(const Query& query, DocumentStatus status, Search search) const;
+
+    template <typename DocumentPredicate, typename Model>
+    std::vector<Document> FindAllDocuments(const Query& query,
+        DocumentPredicate document_predicate, const Model& model) const;
+
+    template <typename DocumentPredicate, typename ExecutionPolicy, typename Model>
+    std::vector<Document> FindAllDocuments(ExecutionPolicy&& policy, const Query& query,
+        DocumentPredicate document_predicate, const Model& model) const;
+
+    template <typename DocumentPredicate, typename Model>
+    std::vector<Document> FindTopDocumentsMaxScore(const IndexSegment& segment, const Query& query,
+        DocumentPredicate document_predicate, DocumentOrdinal first_ordinal, DocumentOrdinal last_ordinal,
+        const Model& model) const;
 };
 
 template <typename StringContainer>
@@ -149,27 +595,52 @@ SearchServer::SearchServer(const StringContainer& stop_words)
     }
 }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,
-    DocumentPredicate document_predicate) const {
-    const auto query = ParseQuery(raw_query);
+template <typename ExecutionPolicy>
+size_t SearchServer::GetParallelism(const ExecutionPolicy& policy) const
+{
+    if constexpr (std::is_same_v<ExecutionPolicy, ThreadPool>)
+    {
+        // the calling thread works too
+        return policy.GetWorkerCount() + 1;
+    }
+    else if (IsParallelPolicy<ExecutionPolicy>() && thread_pool_)
+    {
+        return thread_pool_->GetWorkerCount() + 1;
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
 
-    auto matched_documents = FindAllDocuments(query, document_predicate);
+template <typename ExecutionPolicy, typename Iterator, typename Function>
+void SearchServer::ForEachInParallel(ExecutionPolicy&& policy, Iterator first, Iterator last, Function function,
+    TaskPriority priority) const
+{
+    if constexpr (IsParallelPolicy<ExecutionPolicy>())
+    {
+        if (thread_pool_)
+        {
+            ForEach(*thread_pool_, first, last, function, priority);
+            return;
+        }
+    }
+    ForEach(policy, first, last, function, priority);
+}
 
-    sort(matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < MAX_DIFF) {
-                return lhs.rating > rhs.rating;
-            }
-            else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+template <typename Visitor>
+auto SearchServer::VisitScoringModel(Visitor visit) const
+{
+    if (scoring_model_ == ScoringModel::BM25) {
+        const size_t document_count = document_ordinals_.size();
+        const double average_document_length = total_document_length_ == 0
+            ? 1.0 : total_document_length_ * 1.0 / document_count;
+        return visit(Bm25Model(bm25_parameters_, document_lengths_.data(), average_document_length));
     }
+    return visit(TfIdfModel());
+}
 
-    return matched_documents;
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,
+    DocumentPredicate document_predicate) const {
+    return FindTopDocumentsForQuery(ParseQuery(raw_query), document_predicate);
 }
 
 template <typename DocumentPredicate, typename ExecutionPolicy>
@@ -181,24 +652,7 @@ std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, s
         return SearchServer::FindTopDocuments(raw_query, document_predicate);
     }
 
-    const auto query = ParseQuery(raw_query);
-
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
-
-    sort(matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < MAX_DIFF) {
-                return lhs.rating > rhs.rating;
-            }
-            else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
-
-    return matched_documents;
+    return FindTopDocumentsForQuery(policy, ParseQuery(raw_query), document_predicate);
 }
 
 template<typename ExecutionPolicy>
@@ -209,9 +663,11 @@ std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, s
         return SearchServer::FindTopDocuments(raw_query, status);
     }
 
-    return SearchServer::FindTopDocuments(
-        policy, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
+    const Query query = ParseQuery(raw_query);
+    return FindCachedTopDocuments(query, status, [&]()
+        {
+            return FindTopDocumentsForQuery(policy, query,
+                OrdinalPredicate{ &status_ordinals_[static_cast<size_t>(status)] });
         });
 }
 
@@ -226,159 +682,422 @@ std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, s
     return SearchServer::FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
+template<typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+    const DocumentFilter& filter) const
+{
+    if (typeid(policy) == typeid(std::execution::seq))
+    {
+        return SearchServer::FindTopDocuments(raw_query, filter);
+    }
+
+    const Query query = ParseQuery(raw_query);
+    OrdinalBitmap filter_ordinals;
+    return FindTopDocumentsForQuery(policy, query, OrdinalPredicate{ FindFilterOrdinals(filter, filter_ordinals) });
+}
+
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query,
+const OrdinalBitmap* SearchServer::GetPredicateOrdinals(const DocumentPredicate&) const
+{
+    return nullptr;
+}
+
+template <typename DocumentPredicate>
+bool SearchServer::IsDocumentAccepted(const Query& query, const DocumentPredicate& document_predicate,
+    DocumentOrdinal ordinal) const
+{
+    return document_predicate(ordinal_to_document_id_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal])
+        && (query.phrases.empty() || ContainsPhrases(query.phrases, ordinal));
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsForQuery(const Query& query,
     DocumentPredicate document_predicate) const {
-    std::map<int, double> document_to_relevance;
-    for (std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+    return VisitScoringModel([&](const auto& model) {
+        if (retrieval_strategy_ == RetrievalStrategy::MAX_SCORE) {
+            std::vector<Document> top_documents;
+            for (const IndexSegment* segment : GetSegments()) {
+                const auto segment_documents = FindTopDocumentsMaxScore(*segment, query, document_predicate,
+                    segment->GetFirstOrdinal(), segment->GetLastOrdinal(), model);
+                top_documents.insert(top_documents.end(), segment_documents.begin(), segment_documents.end());
+            }
+            SelectTopDocuments(top_documents);
+            return top_documents;
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+
+        auto matched_documents = FindAllDocuments(query, document_predicate, model);
+        SelectTopDocuments(matched_documents);
+
+        return matched_documents;
+        });
+}
+
+template <typename DocumentPredicate, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocumentsForQuery(ExecutionPolicy&& policy, const Query& query,
+    DocumentPredicate document_predicate) const
+{
+    return VisitScoringModel([&](const auto& model) {
+        if (retrieval_strategy_ == RetrievalStrategy::MAX_SCORE) {
+            const std::vector<SegmentRange> ranges = SplitSegments(GetParallelism(policy));
+            std::vector<std::vector<Document>> part_documents(ranges.size());
+            std::vector<size_t> parts(ranges.size());
+            std::iota(parts.begin(), parts.end(), 0);
+            ForEachInParallel(policy, parts.begin(), parts.end(), [&](size_t part)
+                {
+                    const SegmentRange& range = ranges[part];
+                    part_documents[part] = FindTopDocumentsMaxScore(*range.segment, query, document_predicate,
+                        range.first_ordinal, range.last_ordinal, model);
+                });
+
+            std::vector<Document> top_documents;
+            for (std::vector<Document>& documents : part_documents)
+            {
+                top_documents.insert(top_documents.end(), documents.begin(), documents.end());
             }
+            SelectTopDocuments(top_documents);
+            return top_documents;
         }
+
+        auto matched_documents = FindAllDocuments(policy, query, document_predicate, model);
+        SelectTopDocuments(policy, matched_documents);
+
+        return matched_documents;
+        });
+}
+
+// the query is canonical already: ParseQuery sorts the words and drops repeats, stop words and unknown words
+template <typename Search>
+std::vector<Document> SearchServer::FindCachedTopDocuments(const Query& query, DocumentStatus status, Search search) const
+{
+    if (query_cache_.GetCapacity() == 0)
+    {
+        return search();
+    }
+    const QueryCacheKey key{ query.plus_words, query.minus_words, query.phrases, query.typo_words, status };
+    if (std::optional<std::vector<Document>> documents = query_cache_.Find(key))
+    {
+        return std::move(*documents);
     }
+    const uint64_t generation = query_cache_.GetGeneration();
+    std::vector<Document> documents = search();
+    query_cache_.Insert(key, documents, generation);
+    return documents;
+}
 
-    for (std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
-        }
+// every part keeps only its own top documents, the survivors of all parts are then ranked once more
+template <typename ExecutionPolicy>
+void SearchServer::SelectTopDocuments(ExecutionPolicy&& policy, std::vector<Document>& documents) const
+{
+    const size_t top_count = max_result_document_count_;
+    const size_t part_count = GetParallelism(policy);
+    if (documents.size() <= top_count * part_count)
+    {
+        SelectTopDocuments(documents);
+        return;
+    }
+
+    const size_t part_size = (documents.size() + part_count - 1) / part_count;
+    std::vector<size_t> part_starts(part_count);
+    for (size_t i = 0; i < part_count; ++i)
+    {
+        part_starts[i] = std::min(i * part_size, documents.size());
     }
 
+    ForEachInParallel(policy, part_starts.begin(), part_starts.end(), [&](size_t start)
+        {
+            const auto first = documents.begin() + start;
+            const auto last = documents.begin() + std::min(start + part_size, documents.size());
+            std::partial_sort(first, first + std::min<size_t>(top_count, last - first), last, IsMoreRelevant);
+        });
+
+    std::vector<Document> candidates;
+    candidates.reserve(top_count * part_count);
+    for (const size_t start : part_starts)
+    {
+        const size_t part_top = std::min(top_count, std::min(start + part_size, documents.size()) - start);
+        candidates.insert(candidates.end(), documents.begin() + start, documents.begin() + start + part_top);
+    }
+    SelectTopDocuments(candidates);
+    documents = std::move(candidates);
+}
+
+template <typename DocumentPredicate, typename Model>
+std::vector<Document> SearchServer::FindAllDocuments(const Query& query,
+    DocumentPredicate document_predicate, const Model& model) const {
+    const OrdinalBitmap* predicate_ordinals = GetPredicateOrdinals(document_predicate);
     std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back(
-            { document_id, relevance, documents_.at(document_id).rating });
+    // the dense array of this thread instead of a node per matched document
+    ScoreAccumulator& accumulator = GetThreadScoreAccumulator();
+    for (const IndexSegment* segment : GetSegments()) {
+        accumulator.Reset(segment->GetFirstOrdinal(), segment->GetLastOrdinal());
+        for (const TermId word : query.plus_words) {
+            if (document_freqs_[word] == 0) {
+                continue;
+            }
+            // documents the predicate rejects by their ordinal are never scored
+            accumulator.AddPostings(segment->GetPostings(word), ComputeQueryWordWeight(query, word), model,
+                predicate_ordinals);
+        }
+        for (const TermId word : query.minus_words) {
+            accumulator.ExcludePostings(segment->GetPostings(word));
+        }
+
+        accumulator.ForEachMatched([&](DocumentOrdinal ordinal, double relevance) {
+            const int document_id = ordinal_to_document_id_[ordinal];
+            if (document_id == NO_DOCUMENT_ID) {
+                return;
+            }
+            if (IsDocumentAccepted(query, document_predicate, ordinal)) {
+                matched_documents.push_back({ document_id, relevance, document_ratings_[ordinal] });
+            }
+        });
+        pruning_counters_.scored_postings += accumulator.GetScoredPostingCount();
+        pruning_counters_.skipped_postings += accumulator.GetSkippedPostingCount();
     }
     return matched_documents;
 }
 
-template <typename DocumentPredicate, typename ExecutionPolicy>
+template <typename DocumentPredicate, typename ExecutionPolicy, typename Model>
 std::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy&& policy, const Query& query,
-    DocumentPredicate document_predicate) const
+    DocumentPredicate document_predicate, const Model& model) const
 {
     if(typeid(policy) == typeid(std::execution::seq))
     {
-        return FindAllDocuments(query, document_predicate);
+        return FindAllDocuments(query, document_predicate, model);
     }
 
-    ConcurrentMap<int, double> document_to_relevance;
-    for_each(policy, query.plus_words.begin(), query.plus_words.end(), [&](std::string_view word)
+    std::vector<double> inverse_document_freqs(query.plus_words.size());
+    std::transform(query.plus_words.begin(), query.plus_words.end(), inverse_document_freqs.begin(), [&](const TermId word)
         {
-            if (word_to_document_freqs_.count(word))
-            {
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                for_each(word_to_document_freqs_.at(word).begin(), word_to_document_freqs_.at(word).end(), [&](const std::pair<int, double> id_to_freq)
-                    {
-                        const auto& document_data = documents_.at(id_to_freq.first);
-                        if (document_predicate(id_to_freq.first, document_data.status, document_data.rating)) {
-                            document_to_relevance[id_to_freq.first] += id_to_freq.second * inverse_document_freq;
-                        }
-                    });
-            }
+            return ComputeQueryWordWeight(query, word);
         });
 
-    for_each(policy, query.minus_words.begin(), query.minus_words.end(), [&](std::string_view word)
+    // each part owns a contiguous range of ordinals of one segment and scores it in the dense array of its thread
+    const OrdinalBitmap* predicate_ordinals = GetPredicateOrdinals(document_predicate);
+    const std::vector<SegmentRange> ranges = SplitSegments(GetParallelism(policy));
+    std::vector<std::vector<Document>> part_documents(ranges.size());
+    std::vector<size_t> parts(ranges.size());
+    std::iota(parts.begin(), parts.end(), 0);
+
+    ForEachInParallel(policy, parts.begin(), parts.end(), [&](size_t part)
         {
-            if (word_to_document_freqs_.count(word))
+            const SegmentRange& range = ranges[part];
+            ScoreAccumulator& accumulator = GetThreadScoreAccumulator();
+            accumulator.Reset(range.first_ordinal, range.last_ordinal);
+            for (size_t i = 0; i < query.plus_words.size(); ++i)
             {
-                for_each(word_to_document_freqs_.at(word).begin(), word_to_document_freqs_.at(word).end(), [&](const std::pair<int, double> id_to_freq)
-                    {
-                        document_to_relevance.erase(id_to_freq.first);
-                    });
+                accumulator.AddPostings(range.segment->GetPostings(query.plus_words[i]), inverse_document_freqs[i], model,
+                    predicate_ordinals);
+            }
+            for (const TermId word : query.minus_words)
+            {
+                accumulator.ExcludePostings(range.segment->GetPostings(word));
             }
-        });
 
-    std::vector<Document> matched_documents(document_ids_.size());
-    std::map<int, double> ordinary_doc_to_rel = document_to_relevance.BuildOrdinaryMap();
-    auto new_end = std::transform(policy, ordinary_doc_to_rel.begin(), ordinary_doc_to_rel.end(), matched_documents.begin(), [&](const std::pair<int, double> id_to_relevance)
-        {
-            return Document{ id_to_relevance.first, id_to_relevance.second, documents_.at(id_to_relevance.first).rating };
+            accumulator.ForEachMatched([&](DocumentOrdinal ordinal, double relevance)
+                {
+                    const int document_id = ordinal_to_document_id_[ordinal];
+                    if (document_id == NO_DOCUMENT_ID) {
+                        return;
+                    }
+                    if (IsDocumentAccepted(query, document_predicate, ordinal)) {
+                        part_documents[part].push_back({ document_id, relevance, document_ratings_[ordinal] });
+                    }
+                });
+            pruning_counters_.scored_postings += accumulator.GetScoredPostingCount();
+            pruning_counters_.skipped_postings += accumulator.GetSkippedPostingCount();
         });
-    matched_documents.erase(new_end, matched_documents.end());
+
+    std::vector<Document> matched_documents;
+    for (std::vector<Document>& documents : part_documents)
+    {
+        matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+    }
     return matched_documents;
 }
 
-void MatchDocument(const SearchServer& search_server, std::string_view raw_query, int document_id);
+// Document-at-a-time MaxScore over the ordinals [first_ordinal, last_ordinal).
+// Words are ordered by their score upper bound; words whose bounds together cannot lift a document
+// above the current k-th relevance are only probed for documents found through the other words,
+// and only when the maxima of the blocks the document falls into still leave it a chance
+template <typename DocumentPredicate, typename Model>
+std::vector<Document> SearchServer::FindTopDocumentsMaxScore(const IndexSegment& segment, const Query& query,
+    DocumentPredicate document_predicate, DocumentOrdinal first_ordinal, DocumentOrdinal last_ordinal,
+    const Model& model) const
+{
+    struct WordCursor {
+        PostingCursor cursor;
+        double inverse_document_freq;
+        double upper_bound;
+    };
 
-void FindTopDocuments(const SearchServer& search_server, std::string_view raw_query);
+    std::vector<WordCursor> words;
+    for (const TermId word : query.plus_words) {
+        const PostingList& postings = segment.GetPostings(word);
+        if (document_freqs_[word] == 0 || postings.empty()) {
+            continue;
+        }
+        const double inverse_document_freq = ComputeQueryWordWeight(query, word);
+        words.push_back({ PostingCursor(postings, first_ordinal, last_ordinal), inverse_document_freq,
+            model.GetMaxTermScore(postings.GetMaxTermFreq()) * inverse_document_freq });
+    }
+    std::sort(words.begin(), words.end(), [](const WordCursor& lhs, const WordCursor& rhs) {
+        return lhs.upper_bound < rhs.upper_bound;
+    });
+
+    std::vector<double> bound_sums(words.size());
+    uint64_t posting_count = 0;
+    double bound_sum = 0.0;
+    for (size_t i = 0; i < words.size(); ++i) {
+        bound_sum += words[i].upper_bound;
+        bound_sums[i] = bound_sum;
+        posting_count += words[i].cursor.GetPostingCount();
+    }
 
-void AddDocument(SearchServer& search_server, int document_id, std::string_view raw_query, DocumentStatus status,
-    const std::vector<int>& ratings);
+    std::vector<PostingCursor> minus_cursors;
+    for (const TermId word : query.minus_words) {
+        minus_cursors.emplace_back(segment.GetPostings(word), first_ordinal, last_ordinal);
+    }
 
-template<class ExecutionPolicy>
-void SearchServer::RemoveDocument(ExecutionPolicy&& policy, int document_id) {
-    std::map<std::string_view, double>& id_docs = document_to_word_freqs_.at(document_id);
-    std::vector<std::string_view> words_to_remove(id_docs.size());
-    std::vector<std::string_view> words_no_freq(id_docs.size());
-    std::transform(std::execution::par, id_docs.begin(), id_docs.end(), words_no_freq.begin(),
-        [&](auto& word_to_freq)
-        {
-            return word_to_freq.first;
-        });
+    const OrdinalBitmap* predicate_ordinals = GetPredicateOrdinals(document_predicate);
+    const size_t top_count = max_result_document_count_;
+    std::vector<Document> top_documents;
+    double threshold = -std::numeric_limits<double>::infinity();
+    size_t first_essential = 0;
+    uint64_t scored_postings = 0;
 
-    
-    std::for_each(policy, words_no_freq.begin(), words_no_freq.end(),
-        [&](const auto& word)
-        {
-            word_to_document_freqs_[word].erase(document_id);
-        });
+    while (top_count > 0) {
+        while (first_essential < words.size() && bound_sums[first_essential] <= threshold - MAX_DIFF) {
+            ++first_essential;
+        }
 
-    auto erase_pos = std::copy_if(policy, words_no_freq.begin(), words_no_freq.end(), words_to_remove.begin(), [&](std::string_view word)
-        {
-            return word_to_document_freqs_.at(word).empty();
-        });
+        DocumentOrdinal candidate = last_ordinal;
+        for (size_t i = first_essential; i < words.size(); ++i) {
+            if (!words[i].cursor.AtEnd()) {
+                candidate = std::min(candidate, words[i].cursor.Ordinal());
+            }
+        }
+        if (candidate == last_ordinal) {
+            break;
+        }
 
-    words_to_remove.erase(erase_pos, words_to_remove.end());
+        double relevance = 0.0;
+        for (size_t i = first_essential; i < words.size(); ++i) {
+            PostingCursor& cursor = words[i].cursor;
+            if (!cursor.AtEnd() && cursor.Ordinal() == candidate) {
+                relevance += model.ScoreTerm(candidate, cursor.TermFreq()) * words[i].inverse_document_freq;
+                ++scored_postings;
+                cursor.Next();
+            }
+        }
 
-    document_to_word_freqs_.erase(document_id);
+        // a document the predicate rejects by its ordinal is dropped before the other lists are probed
+        if (predicate_ordinals != nullptr && !predicate_ordinals->Contains(candidate)) {
+            continue;
+        }
 
-    std::for_each(policy, words_to_remove.begin(), words_to_remove.end(),
-        [&](const auto& word)
-        {
-            word_to_document_freqs_.erase(word);
-            word_collector_.erase(std::string(word));
+        double block_bound = relevance;
+        for (size_t i = 0; i < first_essential; ++i) {
+            words[i].cursor.SeekBlock(candidate);
+            block_bound += model.GetMaxTermScore(words[i].cursor.GetBlockMaxTermFreq()) * words[i].inverse_document_freq;
+        }
+        if (block_bound <= threshold - MAX_DIFF) {
+            continue;
+        }
+
+        bool is_pruned = false;
+        for (size_t i = first_essential; i-- > 0;) {
+            if (relevance + bound_sums[i] <= threshold - MAX_DIFF) {
+                is_pruned = true;
+                break;
+            }
+            PostingCursor& cursor = words[i].cursor;
+            cursor.SeekTo(candidate);
+            if (!cursor.AtEnd() && cursor.Ordinal() == candidate) {
+                relevance += model.ScoreTerm(candidate, cursor.TermFreq()) * words[i].inverse_document_freq;
+                ++scored_postings;
+            }
+        }
+        if (is_pruned) {
+            continue;
+        }
+
+        const bool is_excluded = std::any_of(minus_cursors.begin(), minus_cursors.end(), [candidate](PostingCursor& cursor) {
+            cursor.SeekTo(candidate);
+            return !cursor.AtEnd() && cursor.Ordinal() == candidate;
         });
+        if (is_excluded) {
+            continue;
+        }
 
-    document_ids_.erase(document_id);
-    documents_.erase(document_id); //O(logN)
+        const int document_id = ordinal_to_document_id_[candidate];
+        if (document_id == NO_DOCUMENT_ID) {
+            continue;
+        }
+        if (!IsDocumentAccepted(query, document_predicate, candidate)) {
+            continue;
+        }
+
+        PushTopDocument(top_documents, Document(document_id, relevance, document_ratings_[candidate]), top_count);
+        if (top_documents.size() == top_count) {
+            threshold = top_documents.front().relevance;
+        }
+    }
+
+    pruning_counters_.scored_postings += scored_postings;
+    pruning_counters_.skipped_postings += posting_count - scored_postings;
+    return top_documents;
 }
 
-template<class ExecutionPolicy>
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(ExecutionPolicy&& policy, std::string_view raw_query,
-    int document_id) const
+void MatchDocument(const SearchServer& search_server, std::string_view raw_query, int document_id);
+
+void FindTopDocuments(const SearchServer& search_server, std::string_view raw_query);
+
+void AddDocument(SearchServer& search_server, int document_id, std::string_view raw_query, DocumentStatus status,
+    const std::vector<int>& ratings);
+
+template <typename ExecutionPolicy>
+void SearchServer::AddDocuments(ExecutionPolicy&& policy, const std::vector<DocumentInput>& documents)
 {
-    if (typeid(policy) == typeid(std::execution::seq))
+    CheckNewDocumentIds(documents);
+    std::vector<BatchPart> parts = SplitBatch(documents.size(), GetParallelism(policy));
+    ForEachInParallel(policy, parts.begin(), parts.end(), [&](BatchPart& part)
+        {
+            InvertBatchPart(documents, part);
+        }, TaskPriority::LOW);
+    for (const BatchPart& part : parts)
     {
-        return MatchDocument(raw_query, document_id);
+        if (part.error)
+        {
+            std::rethrow_exception(part.error);
+        }
     }
 
-    Query query = ParseQuery(raw_query, true);
-
-    if (std::any_of(policy, query.minus_words.begin(), query.minus_words.end(),
-        [&](std::string_view word)
-        {
-            return word_to_document_freqs_.count(word) && word_to_document_freqs_.at(word).count(document_id);
-        }))
+    FinishMerge(false);
+    // the dictionary is not thread-safe, only the distinct words of every part are interned one by one
+    for (BatchPart& part : parts)
     {
-        return { {}, documents_.at(document_id).status };
+        InternBatchPart(part);
     }
+    ForEachInParallel(policy, parts.begin(), parts.end(), [&](BatchPart& part)
+        {
+            RemapBatchPart(documents, part);
+        }, TaskPriority::LOW);
+    AddBatchParts(documents, parts);
+}
 
-        std::vector<std::string_view> matched_words(query.plus_words.size());
-        auto new_end = std::copy_if(policy, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), [&](std::string_view word)
-            {
-                return word_to_document_freqs_.count(word) && word_to_document_freqs_.at(word).count(document_id);
-            });
-        matched_words.resize(std::distance(matched_words.begin(), new_end));
-        Deduplicator(matched_words);
-        return { matched_words, documents_.at(document_id).status };
+// a removal only marks the ordinal of the document, there is nothing to share between threads
+template<class ExecutionPolicy>
+void SearchServer::RemoveDocument(ExecutionPolicy&&, int document_id) {
+    RemoveDocument(document_id);
+}
+
+// matching walks two sorted lists of a few words, there is nothing worth splitting between threads
+template<class ExecutionPolicy>
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(ExecutionPolicy&&, std::string_view raw_query,
+    int document_id) const
+{
+    return MatchDocument(raw_query, document_id);
 }
 
 
@@ -0,0 +1,155 @@
+#include "snapshot.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+    const char SNAPSHOT_MAGIC[8] = { 'S', 'R', 'C', 'H', 'S', 'N', 'A', 'P' };
+    const uint32_t SNAPSHOT_VERSION = 6;
+    // snapshots are only read back on machines with the same byte order and word size
+    const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+    const size_t SNAPSHOT_ALIGNMENT = 8;
+
+    size_t AlignOffset(size_t offset)
+    {
+        return (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+    }
+}
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const string& path)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER file_size;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        throw invalid_argument("Cannot map file "s + path);
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* data = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (data == nullptr) {
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        throw invalid_argument("Cannot map file "s + path);
+    }
+    file_ = file;
+    mapping_ = mapping;
+    data_ = static_cast<const char*>(data);
+    size_ = static_cast<size_t>(file_size.QuadPart);
+}
+
+MappedFile::~MappedFile()
+{
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_);
+    CloseHandle(file_);
+}
+
+#else
+
+MappedFile::MappedFile(const string& path)
+{
+    const int file = open(path.c_str(), O_RDONLY);
+    struct stat file_stat;
+    if (file < 0 || fstat(file, &file_stat) != 0 || file_stat.st_size == 0) {
+        if (file >= 0) {
+            close(file);
+        }
+        throw invalid_argument("Cannot map file "s + path);
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (data == MAP_FAILED) {
+        throw invalid_argument("Cannot map file "s + path);
+    }
+    data_ = static_cast<const char*>(data);
+    size_ = static_cast<size_t>(file_stat.st_size);
+}
+
+MappedFile::~MappedFile()
+{
+    munmap(const_cast<char*>(data_), size_);
+}
+
+#endif
+
+const char* MappedFile::data() const
+{
+    return data_;
+}
+
+size_t MappedFile::size() const
+{
+    return size_;
+}
+
+SnapshotWriter::SnapshotWriter(ostream& out)
+    : out_(out)
+{
+    WriteElements(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    WriteValue(SNAPSHOT_VERSION);
+    WriteValue(SNAPSHOT_BYTE_ORDER);
+    WriteValue(static_cast<uint32_t>(sizeof(size_t)));
+}
+
+void SnapshotWriter::BeginArray(size_t count)
+{
+    WriteValue(static_cast<uint64_t>(count));
+}
+
+void SnapshotWriter::EndArray()
+{
+    static const char padding[SNAPSHOT_ALIGNMENT] = {};
+    const uint64_t aligned_offset = AlignOffset(offset_);
+    out_.write(padding, aligned_offset - offset_);
+    offset_ = aligned_offset;
+}
+
+void SnapshotWriter::WriteBytes(const void* data, size_t size)
+{
+    WriteElements(static_cast<const char*>(data), size);
+    EndArray();
+}
+
+SnapshotReader::SnapshotReader(const MappedFile& file)
+    : file_(file)
+{
+    if (file_.size() < sizeof(SNAPSHOT_MAGIC)
+        || !equal(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + sizeof(SNAPSHOT_MAGIC), file_.data())) {
+        throw invalid_argument("File is not a search server snapshot"s);
+    }
+    offset_ = sizeof(SNAPSHOT_MAGIC);
+    if (ReadValue<uint32_t>() != SNAPSHOT_VERSION) {
+        throw invalid_argument("Unsupported snapshot version"s);
+    }
+    if (ReadValue<uint32_t>() != SNAPSHOT_BYTE_ORDER || ReadValue<uint32_t>() != sizeof(size_t)) {
+        throw invalid_argument("Snapshot was written on an incompatible platform"s);
+    }
+}
+
+const char* SnapshotReader::ReadBytes(size_t size)
+{
+    if (size > file_.size() - offset_) {
+        throw invalid_argument("Snapshot is truncated"s);
+    }
+    const char* data = file_.data() + offset_;
+    offset_ = min(AlignOffset(offset_ + size), file_.size());
+    return data;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "mapped_array.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+using namespace std::literals::string_literals;
+
+// Read-only mapping of a whole file. Every process mapping the same file shares its pages
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    const char* data() const;
+
+    size_t size() const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+
+// Snapshot layout: a header with the format version, then values and arrays in the order they were written.
+// Every item starts at a multiple of 8 bytes, so arrays can be used right from the mapped file
+class SnapshotWriter
+{
+public:
+    explicit SnapshotWriter(std::ostream& out);
+
+    template <typename T>
+    void WriteValue(const T& value);
+
+    template <typename T>
+    void WriteArray(const T* data, size_t count);
+
+    // array written in pieces: the element count first, then exactly that many elements
+    void BeginArray(size_t count);
+
+    template <typename T>
+    void WriteElements(const T* data, size_t count);
+
+    void EndArray();
+
+private:
+    void WriteBytes(const void* data, size_t size);
+
+    std::ostream& out_;
+    uint64_t offset_ = 0;
+};
+
+class SnapshotReader
+{
+public:
+    explicit SnapshotReader(const MappedFile& file);
+
+    template <typename T>
+    T ReadValue();
+
+    template <typename T>
+    MappedArray<T> ReadArray();
+
+private:
+    const char* ReadBytes(size_t size);
+
+    const MappedFile& file_;
+    size_t offset_ = 0;
+};
+
+template <typename T>
+void SnapshotWriter::WriteValue(const T& value)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    WriteBytes(&value, sizeof(T));
+}
+
+template <typename T>
+void SnapshotWriter::WriteArray(const T* data, size_t count)
+{
+    BeginArray(count);
+    WriteElements(data, count);
+    EndArray();
+}
+
+template <typename T>
+void SnapshotWriter::WriteElements(const T* data, size_t count)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    out_.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+    offset_ += count * sizeof(T);
+}
+
+template <typename T>
+T SnapshotReader::ReadValue()
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value;
+    std::char_traits<char>::copy(reinterpret_cast<char*>(&value), ReadBytes(sizeof(T)), sizeof(T));
+    return value;
+}
+
+template <typename T>
+MappedArray<T> SnapshotReader::ReadArray()
+{
+    static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= 8);
+    const uint64_t count = ReadValue<uint64_t>();
+    if (count > (file_.size() - offset_) / sizeof(T)) {
+        throw std::invalid_argument("Snapshot is truncated"s);
+    }
+    return MappedArray<T>(reinterpret_cast<const T*>(ReadBytes(count * sizeof(T))), count);
+}
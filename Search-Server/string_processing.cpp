@@ -1,23 +1,120 @@
 #include "string_processing.h"
 
+// every x86-64 compiler has SSE2, MSVC just does not define __SSE2__ for it
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define STRING_PROCESSING_SSE2
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
 using namespace std;
 
-vector<string_view> SplitIntoWordsView(string_view stop_words_text) {
-    string_view str = stop_words_text;
-    vector<string_view> result;
-    if (str.empty())
+namespace
+{
+    bool IsControlChar(char c)
     {
-        return result;
+        return static_cast<unsigned char>(c) < ' ';
     }
 
-    str.remove_prefix(str.find_first_not_of(" ") == str.npos ? str.size() : str.find_first_not_of(" "));
+    // scalar tokenizer for text[from, to), shares its state with the vector loop
+    void SplitRange(string_view text, size_t from, size_t to, bool& in_word, size_t& word_start,
+        vector<string_view>& words, size_t& first_invalid_word)
+    {
+        for (size_t i = from; i < to; ++i)
+        {
+            if (text[i] == ' ')
+            {
+                if (in_word)
+                {
+                    words.push_back(text.substr(word_start, i - word_start));
+                    in_word = false;
+                }
+                continue;
+            }
+            if (!in_word)
+            {
+                word_start = i;
+                in_word = true;
+            }
+            if (IsControlChar(text[i]) && first_invalid_word == string_view::npos)
+            {
+                first_invalid_word = words.size();
+            }
+        }
+    }
 
-    while (!str.empty()) {
-        int64_t space = str.find(' ');
-        result.push_back(str.find_first_not_of(" ") == str.npos ? str.substr(0) : str.substr(0, space));
-        str.remove_prefix(space == static_cast<int64_t>(str.npos) ? str.size() : space);
-        str.remove_prefix(str.find_first_not_of(" ") == str.npos ? str.size() : str.find_first_not_of(" "));
+#if defined(STRING_PROCESSING_SSE2)
+    // index of the lowest set bit, mask is not 0
+    int CountTrailingZeros(uint32_t mask)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctz(mask);
+#endif
     }
+#endif
+}
 
+vector<string_view> SplitIntoWordsView(string_view stop_words_text) {
+    vector<string_view> result;
+    SplitIntoWordsView(stop_words_text, result);
     return result;
-}
\ No newline at end of file
+}
+
+size_t SplitIntoWordsView(string_view text, vector<string_view>& words)
+{
+    words.clear();
+    bool in_word = false;
+    size_t word_start = 0;
+    size_t first_invalid_word = string_view::npos;
+    size_t i = 0;
+
+#if defined(STRING_PROCESSING_SSE2)
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i last_control = _mm_set1_epi8(' ' - 1);
+    for (; i + 16 <= text.size(); i += 16)
+    {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + i));
+        const uint32_t space_mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, spaces)));
+        const uint32_t control_mask = static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(chunk, last_control), last_control)));
+
+        if (control_mask != 0 && first_invalid_word == string_view::npos)
+        {
+            SplitRange(text, i, i + 16, in_word, word_start, words, first_invalid_word);
+            continue;
+        }
+
+        // bit k is set where the space state differs from the one of the previous byte
+        const uint32_t previous_space_mask = (space_mask << 1) | (in_word ? 0u : 1u);
+        uint32_t boundaries = (space_mask ^ previous_space_mask) & 0xFFFFu;
+        while (boundaries != 0)
+        {
+            const int k = CountTrailingZeros(boundaries);
+            boundaries &= boundaries - 1;
+            if ((space_mask >> k) & 1u)
+            {
+                words.push_back(text.substr(word_start, i + k - word_start));
+                in_word = false;
+            }
+            else
+            {
+                word_start = i + k;
+                in_word = true;
+            }
+        }
+    }
+#endif
+
+    SplitRange(text, i, text.size(), in_word, word_start, words, first_invalid_word);
+    if (in_word)
+    {
+        words.push_back(text.substr(word_start));
+    }
+    return first_invalid_word == string_view::npos ? words.size() : first_invalid_word;
+}
@@ -8,6 +8,10 @@
 
 std::vector<std::string_view> SplitIntoWordsView(std::string_view stop_words_text);
 
+// Splits text by spaces into words, reusing their storage, and checks the words for control characters
+// in the same pass. Returns the index of the first word containing one, or words.size() if there is none
+size_t SplitIntoWordsView(std::string_view text, std::vector<std::string_view>& words);
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string, std::less<>> non_empty_strings;
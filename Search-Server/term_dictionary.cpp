@@ -0,0 +1,303 @@
+#include "term_dictionary.h"
+
+using namespace std;
+
+namespace
+{
+    // the small sorted array becomes a run once it holds this many terms
+    const size_t NEW_SORTED_TERM_COUNT = 1024;
+}
+
+TermDictionary TermDictionary::Open(SnapshotReader& reader)
+{
+    TermDictionary dictionary;
+    dictionary.mapped_text_ = reader.ReadArray<char>();
+    dictionary.mapped_offsets_ = reader.ReadArray<uint64_t>();
+    dictionary.hashes_ = reader.ReadArray<uint64_t>();
+    dictionary.slots_ = reader.ReadArray<TermId>();
+    dictionary.sorted_runs_.push_back(reader.ReadArray<TermId>());
+
+    const MappedArray<uint64_t>& offsets = dictionary.mapped_offsets_;
+    const size_t slot_count = dictionary.slots_.size();
+    if (offsets.empty() || offsets.back() != dictionary.mapped_text_.size()
+        || dictionary.hashes_.size() != dictionary.size()
+        || (slot_count & (slot_count - 1)) != 0 || dictionary.size() * 2 > slot_count
+        || dictionary.sorted_runs_[0].size() != dictionary.size()) {
+        throw invalid_argument("Snapshot has a broken term dictionary"s);
+    }
+    return dictionary;
+}
+
+void TermDictionary::Save(SnapshotWriter& writer) const
+{
+    uint64_t text_size = 0;
+    vector<uint64_t> offsets(1, 0);
+    for (TermId term_id = 0; term_id < size(); ++term_id)
+    {
+        text_size += GetTerm(term_id).size();
+        offsets.push_back(text_size);
+    }
+
+    writer.BeginArray(text_size);
+    for (TermId term_id = 0; term_id < size(); ++term_id)
+    {
+        const string_view term = GetTerm(term_id);
+        writer.WriteElements(term.data(), term.size());
+    }
+    writer.EndArray();
+    writer.WriteArray(offsets.data(), offsets.size());
+    writer.WriteArray(hashes_.data(), hashes_.size());
+    writer.WriteArray(slots_.data(), slots_.size());
+
+    vector<TermId> sorted_ids;
+    vector<TermId> merged;
+    ForEachSortedRun([this, &sorted_ids, &merged](const TermId* first, const TermId* last) {
+        merged.resize(sorted_ids.size() + (last - first));
+        merge(sorted_ids.begin(), sorted_ids.end(), first, last, merged.begin(), [this](TermId lhs, TermId rhs) {
+            return IsTermLess(lhs, rhs);
+            });
+        swap(sorted_ids, merged);
+        });
+    writer.WriteArray(sorted_ids.data(), sorted_ids.size());
+}
+
+TermId TermDictionary::Insert(string_view term)
+{
+    if ((size() + 1) * 2 > slots_.size())
+    {
+        Rehash(slots_.empty() ? 16 : slots_.size() * 2);
+    }
+
+    const uint64_t hash = Hash(term);
+    const size_t slot = FindSlot(term, hash);
+    if (slots_[slot] != NO_TERM)
+    {
+        return slots_[slot];
+    }
+
+    const TermId term_id = static_cast<TermId>(size());
+    terms_.emplace_back(term);
+    hashes_.Mutable().push_back(hash);
+    slots_.Mutable()[slot] = term_id;
+    AddSortedTerm(term_id);
+    return term_id;
+}
+
+TermId TermDictionary::Find(string_view term) const
+{
+    if (slots_.empty())
+    {
+        return NO_TERM;
+    }
+    return slots_[FindSlot(term, Hash(term))];
+}
+
+string_view TermDictionary::GetTerm(TermId term_id) const
+{
+    const size_t mapped_term_count = GetMappedTermCount();
+    if (term_id >= mapped_term_count)
+    {
+        return terms_[term_id - mapped_term_count];
+    }
+    const uint64_t begin = mapped_offsets_[term_id];
+    return string_view(mapped_text_.data() + begin, mapped_offsets_[term_id + 1] - begin);
+}
+
+size_t TermDictionary::size() const
+{
+    return GetMappedTermCount() + terms_.size();
+}
+
+uint64_t TermDictionary::Hash(string_view term)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (const char c : term)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+size_t TermDictionary::GetMappedTermCount() const
+{
+    return mapped_offsets_.empty() ? 0 : mapped_offsets_.size() - 1;
+}
+
+size_t TermDictionary::FindSlot(string_view term, uint64_t hash) const
+{
+    const size_t mask = slots_.size() - 1;
+    size_t slot = hash & mask;
+    while (slots_[slot] != NO_TERM
+        && (hashes_[slots_[slot]] != hash || GetTerm(slots_[slot]) != term))
+    {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void TermDictionary::Rehash(size_t slot_count)
+{
+    vector<TermId>& slots = slots_.Mutable();
+    slots.assign(slot_count, NO_TERM);
+    const size_t mask = slot_count - 1;
+    for (TermId term_id = 0; term_id < size(); ++term_id)
+    {
+        size_t slot = hashes_[term_id] & mask;
+        while (slots[slot] != NO_TERM)
+        {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = term_id;
+    }
+}
+
+void TermDictionary::AddSortedTerm(TermId term_id)
+{
+    const auto position = upper_bound(new_sorted_ids_.begin(), new_sorted_ids_.end(), term_id,
+        [this](TermId lhs, TermId rhs) {
+            return IsTermLess(lhs, rhs);
+        });
+    new_sorted_ids_.insert(position, term_id);
+    if (new_sorted_ids_.size() < NEW_SORTED_TERM_COUNT)
+    {
+        return;
+    }
+
+    sorted_runs_.emplace_back();
+    swap(sorted_runs_.back().Mutable(), new_sorted_ids_);
+    while (sorted_runs_.size() > 1 && sorted_runs_[sorted_runs_.size() - 2].size() <= 2 * sorted_runs_.back().size())
+    {
+        const MappedArray<TermId>& older = sorted_runs_[sorted_runs_.size() - 2];
+        const MappedArray<TermId>& newer = sorted_runs_.back();
+        vector<TermId> sorted_ids(older.size() + newer.size());
+        merge(older.begin(), older.end(), newer.begin(), newer.end(), sorted_ids.begin(), [this](TermId lhs, TermId rhs) {
+            return IsTermLess(lhs, rhs);
+            });
+        sorted_runs_.pop_back();
+        sorted_runs_.back() = MappedArray<TermId>();
+        sorted_runs_.back().Mutable() = move(sorted_ids);
+    }
+}
+
+bool TermDictionary::IsTermLess(TermId lhs, TermId rhs) const
+{
+    return GetTerm(lhs) < GetTerm(rhs);
+}
+
+pair<const TermId*, const TermId*> TermDictionary::FindPrefixRange(const TermId* first, const TermId* last,
+    string_view prefix) const
+{
+    first = lower_bound(first, last, prefix, [this](TermId term_id, string_view prefix) {
+        return GetTerm(term_id) < prefix;
+        });
+    last = partition_point(first, last, [this, prefix](TermId term_id) {
+        return GetTerm(term_id).substr(0, prefix.size()) == prefix;
+        });
+    return { first, last };
+}
+
+vector<pair<TermId, uint32_t>> TermDictionary::FindWithinDistance(string_view term, uint32_t max_distance) const
+{
+    vector<pair<TermId, uint32_t>> matches;
+    vector<uint32_t> rows(term.size() + 1);
+    for (size_t i = 0; i <= term.size(); ++i)
+    {
+        rows[i] = static_cast<uint32_t>(i);
+    }
+    ForEachSortedRun([&](const TermId* first, const TermId* last) {
+        FindWithinDistance(first, last, 0, term, max_distance, rows, matches);
+        });
+    return matches;
+}
+
+void TermDictionary::FindWithinDistance(const TermId* first, const TermId* last, size_t depth, string_view term,
+    uint32_t max_distance, vector<uint32_t>& rows, vector<pair<TermId, uint32_t>>& matches) const
+{
+    const size_t row_size = term.size() + 1;
+    const size_t row = depth * row_size;
+    // a term ending here sorts before the longer ones
+    if (first != last && GetTerm(*first).size() == depth)
+    {
+        if (rows[row + term.size()] <= max_distance)
+        {
+            matches.push_back({ *first, rows[row + term.size()] });
+        }
+        ++first;
+    }
+
+    if (rows.size() < row + 2 * row_size)
+    {
+        rows.resize(row + 2 * row_size);
+    }
+    const auto get_char = [this, depth](TermId term_id) {
+        return static_cast<unsigned char>(GetTerm(term_id)[depth]);
+    };
+    // the child for character c starting at child_first, returns its end
+    const auto visit_child = [&](const TermId* child_first, unsigned char c) {
+        const auto has_char = [&get_char, c](TermId term_id) {
+            return get_char(term_id) == c;
+        };
+        // galloping keeps the cost of finding a child proportional to its own size rather than to its parent's
+        size_t step = 1;
+        while (step < static_cast<size_t>(last - child_first) && has_char(child_first[step]))
+        {
+            step *= 2;
+        }
+        const TermId* child_last = partition_point(child_first + step / 2,
+            child_first + min(step, static_cast<size_t>(last - child_first)), has_char);
+
+        uint32_t min_distance = static_cast<uint32_t>(depth + 1);
+        rows[row + row_size] = min_distance;
+        for (size_t i = 1; i <= term.size(); ++i)
+        {
+            const uint32_t distance = min({ rows[row + i] + 1, rows[row + row_size + i - 1] + 1,
+                rows[row + i - 1] + (static_cast<unsigned char>(term[i - 1]) == c ? 0 : 1) });
+            rows[row + row_size + i] = distance;
+            min_distance = min(min_distance, distance);
+        }
+        if (min_distance <= max_distance)
+        {
+            FindWithinDistance(child_first, child_last, depth + 1, term, max_distance, rows, matches);
+        }
+        return child_last;
+    };
+
+    const uint32_t min_distance = *min_element(rows.begin() + row, rows.begin() + row + row_size);
+    if (min_distance < max_distance)
+    {
+        while (first != last)
+        {
+            first = visit_child(first, get_char(*first));
+        }
+        return;
+    }
+
+    // Every cell grows by one unless it continues a match along the diagonal, so only the characters of term
+    // following a cell at max_distance can lead to a match. Their children are found by binary search, the
+    // others are skipped without being looked at. At most 2 * max_distance + 1 cells are that close
+    string chars;
+    for (size_t i = 0; i < term.size(); ++i)
+    {
+        if (rows[row + i] <= max_distance)
+        {
+            chars.push_back(term[i]);
+        }
+    }
+    // in the order of the terms, which compare characters as unsigned
+    sort(chars.begin(), chars.end(), [](char lhs, char rhs) {
+        return static_cast<unsigned char>(lhs) < static_cast<unsigned char>(rhs);
+        });
+    chars.erase(unique(chars.begin(), chars.end()), chars.end());
+    for (const char term_char : chars)
+    {
+        const unsigned char c = static_cast<unsigned char>(term_char);
+        first = partition_point(first, last, [&get_char, c](TermId term_id) {
+            return get_char(term_id) < c;
+            });
+        if (first != last && get_char(*first) == c)
+        {
+            first = visit_child(first, c);
+        }
+    }
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "mapped_array.h"
+#include "snapshot.h"
+
+#include <cstdint>
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using TermId = uint32_t;
+
+const TermId NO_TERM = std::numeric_limits<TermId>::max();
+
+// (term id, share of the document) pairs of one document sorted by term id, a view of storage owned elsewhere
+class TermFrequencies
+{
+public:
+    using value_type = std::pair<TermId, double>;
+
+    TermFrequencies() = default;
+
+    TermFrequencies(const value_type* first, const value_type* last)
+        : first_(first)
+        , last_(last)
+    {
+    }
+
+    TermFrequencies(const std::vector<value_type>& word_freqs)
+        : first_(word_freqs.data())
+        , last_(word_freqs.data() + word_freqs.size())
+    {
+    }
+
+    const value_type* begin() const
+    {
+        return first_;
+    }
+
+    const value_type* end() const
+    {
+        return last_;
+    }
+
+    size_t size() const
+    {
+        return last_ - first_;
+    }
+
+    bool empty() const
+    {
+        return first_ == last_;
+    }
+
+    const value_type& operator[](size_t index) const
+    {
+        return first_[index];
+    }
+
+private:
+    const value_type* first_ = nullptr;
+    const value_type* last_ = nullptr;
+};
+
+// Interns every indexed word once and hands out dense ids 0, 1, 2, ...
+// Lookup is an open-addressing hash table with linear probing, terms are never removed.
+// Term ids are also kept in the lexicographic order of their terms for prefix lookups, as a few sorted runs:
+// the newest terms go into a small sorted array that becomes a run once it fills up, and the last two runs
+// are merged while the older one is at most twice as large, so every id takes part in O(log n) merges.
+// An opened snapshot keeps its terms and the table in the mapped file, words added later are stored separately
+class TermDictionary
+{
+public:
+    static TermDictionary Open(SnapshotReader& reader);
+
+    void Save(SnapshotWriter& writer) const;
+
+    TermId Insert(std::string_view term);
+
+    TermId Find(std::string_view term) const;
+
+    std::string_view GetTerm(TermId term_id) const;
+
+    // calls visit(term_id) for the terms starting with prefix in lexicographic order while it returns true
+    template <typename Visitor>
+    void ForEachWithPrefix(std::string_view prefix, Visitor visit) const;
+
+    // (term id, edit distance) of every term at most max_distance insertions, deletions or substitutions
+    // away from term, term itself included when it is in the dictionary
+    std::vector<std::pair<TermId, uint32_t>> FindWithinDistance(std::string_view term, uint32_t max_distance) const;
+
+    size_t size() const;
+
+private:
+    // fixed hash function, so that tables saved in a snapshot stay valid for any build reading it
+    static uint64_t Hash(std::string_view term);
+
+    size_t GetMappedTermCount() const;
+
+    size_t FindSlot(std::string_view term, uint64_t hash) const;
+
+    void Rehash(size_t slot_count);
+
+    void AddSortedTerm(TermId term_id);
+
+    bool IsTermLess(TermId lhs, TermId rhs) const;
+
+    // calls function(first, last) for every sorted run and the small sorted array
+    template <typename Function>
+    void ForEachSortedRun(Function function) const;
+
+    // the part of the sorted term ids [first, last) starting with prefix
+    std::pair<const TermId*, const TermId*> FindPrefixRange(const TermId* first, const TermId* last,
+        std::string_view prefix) const;
+
+    // Walks the sorted term ids [first, last) sharing their first depth characters as the nodes of a trie.
+    // rows holds a row of the edit distance table for every character of the path, the last one being the state
+    // of the Levenshtein automaton of term; a subtree is skipped once no cell of its row is within max_distance,
+    // and once the best cell is at max_distance only the children continuing a match with term are looked up
+    void FindWithinDistance(const TermId* first, const TermId* last, size_t depth, std::string_view term,
+        uint32_t max_distance, std::vector<uint32_t>& rows, std::vector<std::pair<TermId, uint32_t>>& matches) const;
+
+    MappedArray<char> mapped_text_;
+    MappedArray<uint64_t> mapped_offsets_;
+    std::deque<std::string> terms_;
+    MappedArray<uint64_t> hashes_;
+    MappedArray<TermId> slots_;
+    // from the oldest and largest run on, the first one may be mapped from a snapshot
+    std::vector<MappedArray<TermId>> sorted_runs_;
+    std::vector<TermId> new_sorted_ids_;
+};
+
+template <typename Function>
+void TermDictionary::ForEachSortedRun(Function function) const
+{
+    for (const MappedArray<TermId>& run : sorted_runs_)
+    {
+        function(run.begin(), run.end());
+    }
+    function(new_sorted_ids_.data(), new_sorted_ids_.data() + new_sorted_ids_.size());
+}
+
+template <typename Visitor>
+void TermDictionary::ForEachWithPrefix(std::string_view prefix, Visitor visit) const
+{
+    // the terms with prefix of every run, merged by taking the least of their first terms
+    std::vector<std::pair<const TermId*, const TermId*>> ranges;
+    ForEachSortedRun([this, prefix, &ranges](const TermId* first, const TermId* last) {
+        const auto range = FindPrefixRange(first, last, prefix);
+        if (range.first != range.second)
+        {
+            ranges.push_back(range);
+        }
+        });
+    while (!ranges.empty())
+    {
+        const auto least = std::min_element(ranges.begin(), ranges.end(), [this](const auto& lhs, const auto& rhs) {
+            return IsTermLess(*lhs.first, *rhs.first);
+            });
+        if (!visit(*least->first++))
+        {
+            return;
+        }
+        if (least->first == least->second)
+        {
+            ranges.erase(least);
+        }
+    }
+}
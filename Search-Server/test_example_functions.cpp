@@ -0,0 +1,1434 @@
+#include "test_example_functions.h"
+#include "near_duplicates.h"
+#include "process_queries.h"
+#include "remove_duplicates_h.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <execution>
+#include <future>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+void AssertImpl(bool value, const string& expr_str, const string& file, const string& func, unsigned line,
+    const string& hint)
+{
+    if (!value) {
+        cerr << file << "("s << line << "): "s << func << ": "s;
+        cerr << "ASSERT("s << expr_str << ") failed."s;
+        if (!hint.empty()) {
+            cerr << " Hint: "s << hint;
+        }
+        cerr << endl;
+        abort();
+    }
+}
+
+namespace
+{
+    vector<int> GetIds(const vector<Document>& documents)
+    {
+        vector<int> ids;
+        for (const Document& document : documents) {
+            ids.push_back(document.id);
+        }
+        return ids;
+    }
+
+    bool AreSameDocuments(const vector<Document>& lhs, const vector<Document>& rhs)
+    {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            if (lhs[i].id != rhs[i].id || abs(lhs[i].relevance - rhs[i].relevance) > MAX_DIFF
+                || lhs[i].rating != rhs[i].rating) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void AddTestDocuments(SearchServer& server)
+    {
+        server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, { 8, -3 });
+        server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+        server.AddDocument(4, "groomed starling eugene"s, DocumentStatus::BANNED, { 9 });
+    }
+
+    // ratings are unique so that the order of the results never depends on ties
+    void AddGeneratedDocuments(SearchServer& server, int first_id, int count)
+    {
+        for (int id = first_id; id < first_id + count; ++id) {
+            server.AddDocument(id, "word"s + to_string(id % 7) + " word"s + to_string(id % 11) + " word"s
+                + to_string(id % 13) + " common"s, id % 10 == 9 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL,
+                { id });
+        }
+    }
+
+    const vector<string> GENERATED_QUERIES = { "word1 word2 common"s, "word3 -word5"s, "word12 word6 -word0"s };
+
+    vector<vector<Document>> FindGeneratedQueries(const SearchServer& server)
+    {
+        vector<vector<Document>> results;
+        for (const string& query : GENERATED_QUERIES) {
+            results.push_back(server.FindTopDocuments(query));
+        }
+        return results;
+    }
+
+    bool AreSameResults(const vector<vector<Document>>& lhs, const vector<vector<Document>>& rhs)
+    {
+        return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), AreSameDocuments);
+    }
+}
+
+void TestExcludeStopWordsFromAddedDocumentContent()
+{
+    SearchServer server("in the"s);
+    server.AddDocument(42, "cat in the city"s, DocumentStatus::ACTUAL, { 1, 2, 3 });
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("cat"s)), vector<int>{ 42 });
+    ASSERT_HINT(server.FindTopDocuments("in"s).empty(), "Stop words must be excluded from documents"s);
+}
+
+void TestMinusWordsExcludeDocuments()
+{
+    SearchServer server("and"s);
+    AddTestDocuments(server);
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("fluffy groomed cat -tail"s)), (vector<int>{ 1, 3 }));
+    ASSERT(server.FindTopDocuments("cat -cat"s).empty());
+}
+
+void TestRelevanceAndRating()
+{
+    SearchServer server("and"s);
+    AddTestDocuments(server);
+    const vector<Document> documents = server.FindTopDocuments("fluffy groomed cat"s);
+    ASSERT_EQUAL(documents.size(), 3u);
+    ASSERT_EQUAL(documents[0].id, 2);
+    // fluffy is 2 of 4 words of one document of four, cat is in two of them
+    const double fluffy_idf = log(4.0 / 1.0);
+    const double cat_idf = log(4.0 / 2.0);
+    ASSERT(abs(documents[0].relevance - (0.5 * fluffy_idf + 0.25 * cat_idf)) < MAX_DIFF);
+    ASSERT_EQUAL(documents[0].rating, 5);
+    ASSERT_EQUAL(documents[1].rating, 2);
+    ASSERT_EQUAL(documents[2].rating, -1);
+}
+
+void TestTopDocumentSelection()
+{
+    SearchServer server("and"s);
+    AddTestDocuments(server);
+    // documents 1 and 3 have equal relevance, so the higher rating goes first
+    const vector<Document> documents = server.FindTopDocuments("fluffy groomed cat"s);
+    ASSERT_EQUAL(GetIds(documents), (vector<int>{ 2, 1, 3 }));
+    ASSERT(abs(documents[1].relevance - documents[2].relevance) < MAX_DIFF);
+    ASSERT_EQUAL(documents[1].rating, 2);
+    ASSERT_EQUAL(documents[2].rating, -1);
+
+    // every generated document has the same relevance for common, the best ratings are the largest ids
+    SearchServer generated("and"s);
+    AddGeneratedDocuments(generated, 0, 300);
+    ASSERT_EQUAL(generated.GetMaxResultDocumentCount(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+    ASSERT_EQUAL(GetIds(generated.FindTopDocuments("common"s)), (vector<int>{ 298, 297, 296, 295, 294 }));
+    ASSERT_EQUAL(GetIds(generated.FindTopDocuments(execution::par, "common"s)),
+        (vector<int>{ 298, 297, 296, 295, 294 }));
+
+    generated.SetMaxResultDocumentCount(20);
+    const vector<Document> top = generated.FindTopDocuments("common"s);
+    ASSERT_EQUAL(top.size(), 20u);
+    ASSERT_EQUAL(top.back().id, 277);
+    ASSERT(AreSameDocuments(generated.FindTopDocuments(execution::par, "common"s), top));
+    generated.SetMaxResultDocumentCount(1000);
+    ASSERT_EQUAL(generated.FindTopDocuments("common"s).size(), 270u);
+    ASSERT_EQUAL(generated.FindTopDocuments(execution::par, "common"s).size(), 270u);
+}
+
+void TestStatusAndPredicate()
+{
+    SearchServer server("and"s);
+    AddTestDocuments(server);
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("groomed"s, DocumentStatus::BANNED)), vector<int>{ 4 });
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("groomed cat"s, [](int document_id, DocumentStatus, int) {
+        return document_id % 2 == 1;
+        })), (vector<int>{ 1, 3 }));
+}
+
+void TestPostingListMatchesMapLayout()
+{
+    // the same additions and removals on a posting list and on the map the server used to keep per word
+    PostingList postings;
+    map<DocumentOrdinal, double> expected;
+    for (DocumentOrdinal i = 0; i < 2000; ++i) {
+        const DocumentOrdinal ordinal = i * 7919 % 1000;
+        const double term_freq = 1.0 / (1 + i % 5);
+        postings.Add(ordinal, term_freq);
+        expected[ordinal] += term_freq;
+        if (i % 3 == 0) {
+            const DocumentOrdinal removed = i * 104729 % 1000;
+            ASSERT_EQUAL(postings.Erase(removed), expected.erase(removed) == 1);
+        }
+    }
+    ASSERT_EQUAL(postings.size(), expected.size());
+    ASSERT(!postings.Contains(1000));
+    ASSERT(!postings.Erase(1000));
+
+    auto it = expected.begin();
+    for (PostingCursor cursor(postings, 0, 1000); !cursor.AtEnd(); cursor.Next(), ++it) {
+        ASSERT(it != expected.end());
+        ASSERT_EQUAL(cursor.Ordinal(), it->first);
+        ASSERT(abs(cursor.TermFreq() - it->second) < MAX_DIFF);
+        ASSERT(postings.Contains(it->first));
+    }
+    ASSERT(it == expected.end());
+
+    PostingCursor cursor(postings, 0, 1000);
+    cursor.SeekTo(500);
+    ASSERT_EQUAL(cursor.Ordinal(), expected.lower_bound(500)->first);
+}
+
+void TestScoreAccumulatorReuse()
+{
+    PostingList first;
+    PostingList second;
+    for (DocumentOrdinal ordinal = 0; ordinal < 1000; ordinal += 3) {
+        first.Add(ordinal, 0.5);
+    }
+    for (DocumentOrdinal ordinal = 9; ordinal <= 900; ordinal += 9) {
+        second.Add(ordinal, 0.25);
+    }
+    const TfIdfModel model;
+    const auto collect = [](ScoreAccumulator& accumulator) {
+        vector<pair<DocumentOrdinal, double>> matched;
+        accumulator.ForEachMatched([&matched](DocumentOrdinal ordinal, double relevance) {
+            matched.push_back({ ordinal, relevance });
+        });
+        return matched;
+    };
+
+    ScoreAccumulator accumulator;
+    accumulator.Reset(0, 1000);
+    accumulator.AddPostings(first, 2.0, model);
+    accumulator.ExcludePostings(second);
+    const vector<pair<DocumentOrdinal, double>> matched = collect(accumulator);
+    ASSERT_EQUAL(matched.size(), 334u - 100u);
+    ASSERT(is_sorted(matched.begin(), matched.end()));
+
+    // nothing of the previous range is left over
+    accumulator.Reset(500, 600);
+    accumulator.AddPostings(second, 1.0, model);
+    accumulator.AddPostings(first, 1.0, model);
+    const vector<pair<DocumentOrdinal, double>> reused = collect(accumulator);
+    ScoreAccumulator fresh(500, 600);
+    fresh.AddPostings(second, 1.0, model);
+    fresh.AddPostings(first, 1.0, model);
+    ASSERT(reused == collect(fresh));
+    ASSERT(is_sorted(reused.begin(), reused.end()));
+    ASSERT_EQUAL(reused.front().first, 501u);
+    ASSERT(abs(reused.front().second - 0.5) < MAX_DIFF);
+}
+
+void TestParallelScoringMatchesSequential()
+{
+    // enough documents for several accumulator ranges, with minus words and statuses spread over all of them
+    SearchServer server("and"s);
+    for (int id = 0; id < 3000; ++id) {
+        server.AddDocument(id, "word"s + to_string(id % 7) + " word"s + to_string(id % 11) + " common"s,
+            DocumentStatus(id % 3), { id });
+    }
+    server.SetMaxResultDocumentCount(1000);
+    const auto is_even = [](int document_id, DocumentStatus, int) {
+        return document_id % 2 == 0;
+    };
+    for (const string& query : { "word1 word2 common"s, "word3 -word5"s, "common word10"s, "common -common"s }) {
+        ASSERT_HINT(AreSameDocuments(server.FindTopDocuments(query),
+            server.FindTopDocuments(execution::par, query)), query);
+        ASSERT_HINT(AreSameDocuments(server.FindTopDocuments(query, DocumentStatus::IRRELEVANT),
+            server.FindTopDocuments(execution::par, query, DocumentStatus::IRRELEVANT)), query);
+        ASSERT_HINT(AreSameDocuments(server.FindTopDocuments(query, is_even),
+            server.FindTopDocuments(execution::par, query, is_even)), query);
+    }
+    ASSERT_EQUAL(server.FindTopDocuments(execution::par, "common"s).size(), 1000u);
+}
+
+void TestScoringSkipsRemovedDocumentsInEverySegment()
+{
+    SearchServer server("and"s);
+    server.SetSegmentDocumentCount(16);
+    for (int id = 0; id < 100; ++id) {
+        server.AddDocument(id, "word"s + to_string(id % 5) + " common"s, DocumentStatus::ACTUAL, { id });
+    }
+    server.WaitForMerges();
+    for (int id = 0; id < 100; id += 2) {
+        server.RemoveDocument(id);
+    }
+    server.SetMaxResultDocumentCount(100);
+    const vector<Document> documents = server.FindTopDocuments("common word1 -word3"s);
+    ASSERT_EQUAL(documents.size(), 40u);
+    for (const Document& document : documents) {
+        ASSERT_HINT(document.id % 2 == 1 && document.id % 5 != 3, to_string(document.id));
+    }
+    ASSERT(AreSameDocuments(documents, server.FindTopDocuments(execution::par, "common word1 -word3"s)));
+}
+
+void TestCompressedPostings()
+{
+    SearchServer server("and"s);
+    server.SetMaxResultDocumentCount(1000);
+    AddGeneratedDocuments(server, 0, 1000);
+    const vector<vector<Document>> expected = FindGeneratedQueries(server);
+    const size_t plain_memory = server.GetIndexMemoryUsage();
+
+    server.CompactIndex(PostingEncoding::COMPRESSED);
+    ASSERT(server.GetIndexMemoryUsage() < plain_memory);
+    ASSERT(AreSameResults(FindGeneratedQueries(server), expected));
+    for (size_t i = 0; i < GENERATED_QUERIES.size(); ++i) {
+        ASSERT_HINT(AreSameDocuments(server.FindTopDocuments(execution::par, GENERATED_QUERIES[i]), expected[i]),
+            GENERATED_QUERIES[i]);
+    }
+    server.SetRetrievalStrategy(RetrievalStrategy::MAX_SCORE);
+    ASSERT(AreSameResults(FindGeneratedQueries(server), expected));
+    server.SetRetrievalStrategy(RetrievalStrategy::EXHAUSTIVE);
+
+    // lists go back to plain arrays when they change
+    server.AddDocument(1000, "word1 fresh"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("fresh"s)), vector<int>{ 1000 });
+    server.RemoveDocument(1);
+    for (const Document& document : server.FindTopDocuments("word1"s)) {
+        ASSERT(document.id != 1);
+    }
+}
+
+void TestCompressedPostingCursor()
+{
+    const vector<uint32_t> document_lengths = { 1, 2, 3, 4, 5, 6, 7 };
+    PostingList plain;
+    for (DocumentOrdinal ordinal = 3; ordinal < 1000; ordinal += 3) {
+        const uint32_t length = document_lengths[ordinal % document_lengths.size()];
+        plain.Add(ordinal, (ordinal % length + 1) * (1.0 / length));
+    }
+    vector<uint32_t> lengths_by_ordinal(1000);
+    for (size_t ordinal = 0; ordinal < lengths_by_ordinal.size(); ++ordinal) {
+        lengths_by_ordinal[ordinal] = document_lengths[ordinal % document_lengths.size()];
+    }
+    PostingList compressed = plain;
+    compressed.Compress(lengths_by_ordinal.data(), 0);
+    ASSERT(compressed.IsCompressed());
+    ASSERT(compressed.GetMemoryUsage() < plain.GetMemoryUsage());
+
+    // ranges starting and ending inside blocks, at block bounds and outside the list
+    for (const auto [first, last] : vector<pair<DocumentOrdinal, DocumentOrdinal>>{
+        { 0, 1000 }, { 4, 5 }, { 5, 400 }, { 383, 387 }, { 384, 769 }, { 500, 999 }, { 990, 2000 }, { 1000, 1000 } }) {
+        const string hint = to_string(first) + ".."s + to_string(last);
+        PostingCursor expected(plain, first, last);
+        PostingCursor cursor(compressed, first, last);
+        ASSERT_EQUAL_HINT(cursor.GetPostingCount(), expected.GetPostingCount(), hint);
+        for (; !expected.AtEnd(); expected.Next(), cursor.Next()) {
+            ASSERT_HINT(!cursor.AtEnd(), hint);
+            ASSERT_EQUAL_HINT(cursor.Ordinal(), expected.Ordinal(), hint);
+            ASSERT_EQUAL_HINT(cursor.TermFreq(), expected.TermFreq(), hint);
+        }
+        ASSERT_HINT(cursor.AtEnd(), hint);
+    }
+
+    PostingCursor cursor(compressed, 0, 1000);
+    cursor.SeekTo(500);
+    ASSERT_EQUAL(cursor.Ordinal(), 501u);
+    cursor.SeekTo(900);
+    ASSERT_EQUAL(cursor.Ordinal(), 900u);
+    ASSERT(compressed.Contains(999));
+    ASSERT(!compressed.Contains(998));
+}
+
+void TestSnapshotRoundTrip()
+{
+    const string path = "search_server_test.snapshot"s;
+    SearchServer server("and"s);
+    server.SetMaxResultDocumentCount(1000);
+    AddGeneratedDocuments(server, 0, 500);
+    server.RemoveDocument(7);
+    server.SaveSnapshot(path);
+
+    {
+        SearchServer opened = SearchServer::OpenSnapshot(path);
+        ASSERT_EQUAL(opened.GetDocumentCount(), server.GetDocumentCount());
+        opened.SetMaxResultDocumentCount(1000);
+        ASSERT(AreSameResults(FindGeneratedQueries(opened), FindGeneratedQueries(server)));
+        ASSERT(opened.GetWordFrequencies(42) == server.GetWordFrequencies(42));
+        ASSERT(get<0>(opened.MatchDocument("word0 common"s, 42)) == get<0>(server.MatchDocument("word0 common"s, 42)));
+        ASSERT(vector<int>(opened.begin(), opened.end()) == vector<int>(server.begin(), server.end()));
+
+        // the mapped postings are copied on the first change
+        opened.AddDocument(500, "word1 fresh"s, DocumentStatus::ACTUAL, { 1 });
+        opened.RemoveDocument(8);
+        ASSERT_EQUAL(GetIds(opened.FindTopDocuments("fresh"s)), vector<int>{ 500 });
+        for (const Document& document : opened.FindTopDocuments("word1"s)) {
+            ASSERT(document.id != 8);
+        }
+    }
+    remove(path.c_str());
+
+    bool is_thrown = false;
+    try {
+        SearchServer::OpenSnapshot("no_such_search_server.snapshot"s);
+    }
+    catch (const invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT_HINT(is_thrown, "Opening a missing snapshot must throw"s);
+}
+
+void TestSegmentMerges()
+{
+    SearchServer single_segment("and"s);
+    single_segment.SetMaxResultDocumentCount(1000);
+    AddGeneratedDocuments(single_segment, 0, 1000);
+
+    SearchServer server("and"s);
+    server.SetMaxResultDocumentCount(1000);
+    server.SetSegmentDocumentCount(16);
+    AddGeneratedDocuments(server, 0, 1000);
+    server.WaitForMerges();
+    // 62 frozen segments of 16 documents unless the merges took place
+    ASSERT_HINT(server.GetSegmentCount() < 20, to_string(server.GetSegmentCount()));
+    ASSERT(AreSameResults(FindGeneratedQueries(server), FindGeneratedQueries(single_segment)));
+
+    for (int id = 0; id < 1000; id += 3) {
+        server.RemoveDocument(id);
+        single_segment.RemoveDocument(id);
+    }
+    AddGeneratedDocuments(server, 1000, 200);
+    AddGeneratedDocuments(single_segment, 1000, 200);
+    server.WaitForMerges();
+    ASSERT_EQUAL(server.GetDocumentCount(), single_segment.GetDocumentCount());
+    ASSERT(AreSameResults(FindGeneratedQueries(server), FindGeneratedQueries(single_segment)));
+    for (const string& query : GENERATED_QUERIES) {
+        ASSERT_HINT(AreSameDocuments(server.FindTopDocuments(execution::par, query),
+            single_segment.FindTopDocuments(query)), query);
+    }
+}
+
+void TestBatchOrdersTiesLikeFindTopDocuments()
+{
+    // equal texts and ratings, only the ids tell the documents apart
+    const auto add_documents = [](SearchServer& server) {
+        for (int id = 0; id < 200; ++id) {
+            server.AddDocument(id, id % 2 == 0 ? "cat dog"s : "cat bird"s,
+                id % 5 == 4 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id % 3 });
+        }
+    };
+    const vector<string> queries = { "cat"s, "dog"s, "cat -bird"s, "bird dog"s, "cat"s, "fish"s };
+
+    SearchServer uncached("and"s);
+    uncached.SetQueryCacheCapacity(0);
+    add_documents(uncached);
+    SearchServer server("and"s);
+    server.SetQueryCacheCapacity(100);
+    add_documents(server);
+
+    const vector<vector<Document>> results = server.FindTopDocumentsBatch(queries);
+    ASSERT_EQUAL(results.size(), queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        ASSERT_HINT(AreSameDocuments(results[i], uncached.FindTopDocuments(queries[i])), queries[i]);
+        ASSERT_HINT(AreSameDocuments(results[i], uncached.FindTopDocuments(execution::par, queries[i])), queries[i]);
+        // answered from the entries the batch left in the cache
+        ASSERT_HINT(AreSameDocuments(server.FindTopDocuments(queries[i]), results[i]), queries[i]);
+    }
+    ASSERT_EQUAL(GetIds(results[1]), (vector<int>{ 2, 8, 20, 26, 32 }));
+    ASSERT_EQUAL(server.FindTopDocumentsBatch(queries, DocumentStatus::BANNED)[0].size(), 5u);
+}
+
+void TestConcurrentLruCache()
+{
+    // std::hash<int> spreads consecutive keys evenly over the shards
+    ConcurrentLruCache<int, int> small(5);
+    for (int key = 0; key < 100; ++key) {
+        small.Insert(key, key, small.GetGeneration());
+    }
+    ASSERT_EQUAL(small.GetSize(), 5u);
+    ASSERT_EQUAL(small.GetStats().evictions, 95u);
+
+    ConcurrentLruCache<int, int> cache(100);
+    for (int key = 0; key < 100; ++key) {
+        cache.Insert(key, key * 2, cache.GetGeneration());
+    }
+    ASSERT_EQUAL(cache.GetSize(), 100u);
+    ASSERT_EQUAL(cache.GetStats().evictions, 0u);
+    for (int key = 100; key < 200; ++key) {
+        cache.Insert(key, key * 2, cache.GetGeneration());
+    }
+    ASSERT_EQUAL(cache.GetSize(), 100u);
+    ASSERT_EQUAL(cache.GetStats().evictions, 100u);
+    ASSERT(cache.Find(150) == 300);
+    ASSERT(!cache.Find(50));
+    ASSERT_EQUAL(cache.GetStats().hits, 1u);
+    ASSERT_EQUAL(cache.GetStats().misses, 1u);
+
+    // a value computed before Invalidate() is not kept, older entries are misses and are dropped
+    const uint64_t generation = cache.GetGeneration();
+    cache.Invalidate();
+    cache.Insert(1000, 1, generation);
+    ASSERT(!cache.Find(1000));
+    ASSERT(!cache.Find(150));
+    ASSERT_EQUAL(cache.GetSize(), 99u);
+    ASSERT_EQUAL(cache.GetStats().misses, 3u);
+
+    // the least recently used entry of a shard goes first
+    ConcurrentLruCache<int, int> single_shard(2, 1);
+    single_shard.Insert(1, 1, 0);
+    single_shard.Insert(2, 2, 0);
+    ASSERT(single_shard.Find(1) == 1);
+    single_shard.Insert(3, 3, 0);
+    ASSERT(!single_shard.Find(2));
+    ASSERT(single_shard.Find(1) == 1);
+    ASSERT(single_shard.Find(3) == 3);
+
+    ConcurrentLruCache<int, int> disabled;
+    disabled.Insert(1, 1, 0);
+    ASSERT(!disabled.Find(1));
+    ASSERT_EQUAL(disabled.GetSize(), 0u);
+}
+
+void TestQueryCacheInvalidation()
+{
+    SearchServer server("and"s);
+    server.SetQueryCacheCapacity(10);
+    AddTestDocuments(server);
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("fluffy cat"s)), (vector<int>{ 2, 1 }));
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("fluffy cat"s)), (vector<int>{ 2, 1 }));
+    ASSERT_EQUAL(server.GetQueryCacheStats().hits, 1u);
+    ASSERT_EQUAL(server.GetQueryCacheStats().misses, 1u);
+
+    server.AddDocument(5, "cat"s, DocumentStatus::ACTUAL, { 9 });
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("fluffy cat"s)), (vector<int>{ 2, 5, 1 }));
+    ASSERT_EQUAL(server.GetQueryCacheStats().misses, 2u);
+    server.RemoveDocument(2);
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("fluffy cat"s)), (vector<int>{ 5, 1 }));
+    ASSERT_EQUAL(server.GetQueryCacheStats().misses, 3u);
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("fluffy cat"s)), (vector<int>{ 5, 1 }));
+    ASSERT_EQUAL(server.GetQueryCacheStats().hits, 2u);
+}
+
+void TestPhraseQueries()
+{
+    SearchServer server("the"s);
+    server.SetWordPositions(true);
+    server.AddDocument(1, "new york is big"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "york is new"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "the cat sat on the mat"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "cat sat on mat"s, DocumentStatus::ACTUAL, { 4 });
+
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("\"new york\""s)), vector<int>{ 1 });
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("new york"s)), (vector<int>{ 2, 1 }));
+    // stop words keep their places
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("\"on the mat\""s)), vector<int>{ 3 });
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments(execution::par, "\"new york\""s)), vector<int>{ 1 });
+    ASSERT_EQUAL(GetIds(server.FindTopDocumentsBatch({ "\"new york\" big"s })[0]), vector<int>{ 1 });
+    ASSERT(get<0>(server.MatchDocument("\"new york\""s, 2)).empty());
+    ASSERT_EQUAL(get<0>(server.MatchDocument("\"new york\""s, 1)).size(), 2u);
+
+    bool is_thrown = false;
+    try {
+        server.FindTopDocuments("\"new york"s);
+    }
+    catch (const invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT_HINT(is_thrown, "A phrase without a closing quote must throw"s);
+}
+
+void TestQuotesWithoutWordPositions()
+{
+    SearchServer server("and"s);
+    AddTestDocuments(server);
+    ASSERT(!server.HasWordPositions());
+    // the words in quotes are plain plus words, the order of words does not matter
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("\"cat fluffy\""s)),
+        GetIds(server.FindTopDocuments("cat fluffy"s)));
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments(execution::par, "\"groomed\" -dog"s)), vector<int>{});
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("\"groomed\" -dog"s, DocumentStatus::BANNED)), vector<int>{ 4 });
+    ASSERT_EQUAL(get<0>(server.MatchDocument("\"fluffy tail\""s, 2)).size(), 2u);
+
+    const vector<string> queries = { "\"fluffy cat\""s, "white \"collar\""s, "\"eyes groomed\""s };
+    const vector<vector<Document>> results = ProcessQueries(server, queries);
+    ASSERT_EQUAL(results.size(), queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        ASSERT_HINT(AreSameDocuments(results[i], server.FindTopDocuments(queries[i])), queries[i]);
+        ASSERT_HINT(!results[i].empty(), queries[i]);
+    }
+}
+
+void TestPrefixQueries()
+{
+    SearchServer server("and"s);
+    server.AddDocument(1, "cater catalog"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "category dog"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "cat * dog"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "bird"s, DocumentStatus::ACTUAL, { 4 });
+
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("cat*"s)), (vector<int>{ 1, 2, 3 }));
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("cat* -dog*"s)), vector<int>{ 1 });
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments(execution::par, "cate*"s)), (vector<int>{ 2, 1 }));
+    ASSERT(server.FindTopDocuments("fish*"s).empty());
+
+    // the first words in lexicographic order: cat and catalog
+    server.SetMaxPrefixExpansions(2);
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("cat*"s)), (vector<int>{ 1, 3 }));
+    server.SetMaxPrefixExpansions(64);
+
+    // a lone * is a word of its own
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("*"s)), vector<int>{ 3 });
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("dog -*"s)), vector<int>{ 2 });
+    ASSERT_EQUAL(GetIds(server.FindTopDocumentsBatch({ "* bird"s })[0]), (vector<int>{ 4, 3 }));
+}
+
+void TestTypoTolerance()
+{
+    SearchServer server("and"s);
+    AddTestDocuments(server);
+    ASSERT(server.FindTopDocuments("flufy"s).empty());
+
+    server.SetTypoTolerance(1);
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("flufy"s)), vector<int>{ 2 });
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments(execution::par, "flufy"s)), vector<int>{ 2 });
+    ASSERT_EQUAL(GetIds(server.FindTopDocumentsBatch({ "flufy"s })[0]), vector<int>{ 2 });
+    // flafy is two edits away from fluffy
+    ASSERT(server.FindTopDocuments("flafy"s).empty());
+    server.SetTypoTolerance(2);
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("flafy"s)), vector<int>{ 2 });
+    // minus words are taken as they are
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("cat -tial"s)), (vector<int>{ 2, 1 }));
+
+    const double exact_relevance = server.FindTopDocuments("fluffy"s)[0].relevance;
+    server.SetTypoPenalty(0.5);
+    ASSERT(abs(server.FindTopDocuments("flufy"s)[0].relevance - 0.5 * exact_relevance) < MAX_DIFF);
+    ASSERT(abs(server.FindTopDocuments("fluffy"s)[0].relevance - exact_relevance) < MAX_DIFF);
+
+    server.SetTypoTolerance(0);
+    ASSERT(server.FindTopDocuments("flufy"s).empty());
+
+    bool is_thrown = false;
+    try {
+        server.SetTypoTolerance(MAX_TYPO_DISTANCE + 1);
+    }
+    catch (const invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT_HINT(is_thrown, "Typo tolerance above MAX_TYPO_DISTANCE must throw"s);
+}
+
+void TestTermDictionaryRuns()
+{
+    // every word of 1 to 6 letters over a small alphabet and a few non-ASCII ones, in scrambled order so that
+    // they end up in several sorted runs
+    vector<string> terms;
+    for (size_t length = 1; length <= 6; ++length) {
+        for (size_t code = 0; code < (size_t(1) << (2 * length)); ++code) {
+            string term;
+            for (size_t i = 0; i < length; ++i) {
+                term += "abcd"[(code >> (2 * i)) & 3];
+            }
+            terms.push_back(term);
+        }
+    }
+    for (const string& term : { "\xc3\xa9t\xc3\xa9"s, "\xc3\xa9"s, "a\xc3\xa9"s }) {
+        terms.push_back(term);
+    }
+    TermDictionary dictionary;
+    for (size_t i = 0; i < terms.size(); ++i) {
+        dictionary.Insert(terms[i * 2029 % terms.size()]);
+    }
+    ASSERT_EQUAL(dictionary.size(), terms.size());
+    sort(terms.begin(), terms.end());
+
+    const auto find_with_prefix = [&dictionary](const string& prefix, size_t max_count) {
+        vector<string> found;
+        dictionary.ForEachWithPrefix(prefix, [&](TermId term_id) {
+            found.push_back(string(dictionary.GetTerm(term_id)));
+            return found.size() < max_count;
+            });
+        return found;
+    };
+    ASSERT(find_with_prefix(""s, terms.size()) == terms);
+    ASSERT_EQUAL(find_with_prefix("dcb"s, terms.size()).size(), 1u + 4u + 16u + 64u);
+    ASSERT((find_with_prefix("ab"s, 3) == vector<string>{ "ab"s, "aba"s, "abaa"s }));
+    ASSERT((find_with_prefix("\xc3"s, 3) == vector<string>{ "\xc3\xa9"s, "\xc3\xa9t\xc3\xa9"s }));
+
+    // the same matches as computing the distance to every term
+    vector<uint32_t> rows;
+    for (const string& query : { "abcd"s, "dcbaab"s, "aaaaaaaa"s, "b"s, ""s, "\xc3\xa9t\xc3"s, "abxcd"s }) {
+        for (uint32_t max_distance = 0; max_distance <= 2; ++max_distance) {
+            vector<pair<TermId, uint32_t>> expected;
+            for (const string& term : terms) {
+                rows.assign(query.size() + 1, 0);
+                iota(rows.begin(), rows.end(), 0u);
+                for (size_t i = 1; i <= term.size(); ++i) {
+                    uint32_t diagonal = rows[0];
+                    rows[0] = static_cast<uint32_t>(i);
+                    for (size_t j = 1; j <= query.size(); ++j) {
+                        const uint32_t above = rows[j];
+                        rows[j] = min({ rows[j] + 1, rows[j - 1] + 1, diagonal + (term[i - 1] == query[j - 1] ? 0u : 1u) });
+                        diagonal = above;
+                    }
+                }
+                if (rows.back() <= max_distance) {
+                    expected.push_back({ dictionary.Find(term), rows.back() });
+                }
+            }
+            vector<pair<TermId, uint32_t>> found = dictionary.FindWithinDistance(query, max_distance);
+            sort(expected.begin(), expected.end());
+            sort(found.begin(), found.end());
+            ASSERT_HINT(found == expected, query + " within "s + to_string(max_distance));
+        }
+    }
+}
+
+void TestBm25Scoring()
+{
+    SearchServer server("and"s);
+    server.AddDocument(1, "cat cat cat cat dog"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "cat and bird"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "dog bird fish"s, DocumentStatus::ACTUAL, { 3 });
+    const vector<Document> tf_idf_documents = server.FindTopDocuments("cat"s);
+
+    server.SetScoringModel(ScoringModel::BM25);
+    ASSERT(server.GetScoringModel() == ScoringModel::BM25);
+    // stop words are not counted in the lengths 5, 2 and 3
+    const double average_length = 10.0 / 3.0;
+    const double idf = log(1.0 + (3 - 2 + 0.5) / (2 + 0.5));
+    const auto score = [&](double count, double length, double k1, double b) {
+        return idf * count * (k1 + 1.0) / (count + k1 * (1.0 - b + b * length / average_length));
+    };
+    vector<Document> documents = server.FindTopDocuments("cat"s);
+    ASSERT_EQUAL(GetIds(documents), (vector<int>{ 1, 2 }));
+    ASSERT(abs(documents[0].relevance - score(4, 5, 1.2, 0.75)) < MAX_DIFF);
+    ASSERT(abs(documents[1].relevance - score(1, 2, 1.2, 0.75)) < MAX_DIFF);
+    ASSERT(AreSameDocuments(server.FindTopDocuments(execution::par, "cat"s), documents));
+    ASSERT(AreSameDocuments(server.FindTopDocumentsBatch({ "cat"s })[0], documents));
+    server.SetRetrievalStrategy(RetrievalStrategy::MAX_SCORE);
+    ASSERT(AreSameDocuments(server.FindTopDocuments("cat"s), documents));
+    server.SetRetrievalStrategy(RetrievalStrategy::EXHAUSTIVE);
+
+    // without length normalization only the repeats count, and they saturate
+    server.SetBm25Parameters({ 1.2, 0.0 });
+    documents = server.FindTopDocuments("cat"s);
+    ASSERT(abs(documents[0].relevance - score(4, 5, 1.2, 0.0)) < MAX_DIFF);
+    ASSERT(documents[0].relevance < 4 * documents[1].relevance);
+
+    // the cached inverse document frequencies follow the documents
+    server.AddDocument(4, "cat"s, DocumentStatus::ACTUAL, { 4 });
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), 3u);
+    server.RemoveDocument(4);
+    server.SetScoringModel(ScoringModel::TF_IDF);
+    ASSERT(AreSameDocuments(server.FindTopDocuments("cat"s), tf_idf_documents));
+
+    bool is_thrown = false;
+    try {
+        server.SetBm25Parameters({ 1.2, 1.5 });
+    }
+    catch (const invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT_HINT(is_thrown, "b above 1 must throw"s);
+}
+
+void TestDocumentFilter()
+{
+    SearchServer server("and"s);
+    server.SetMaxResultDocumentCount(1000);
+    AddGeneratedDocuments(server, 0, 1000);
+    server.RemoveDocument(505);
+
+    DocumentFilter filter;
+    filter.statuses = { DocumentStatus::ACTUAL, DocumentStatus::BANNED };
+    filter.min_rating = 100;
+    filter.max_rating = 600;
+    filter.min_document_id = 500;
+    const auto matches = [&filter](int document_id, DocumentStatus status, int rating) {
+        return find(filter.statuses.begin(), filter.statuses.end(), status) != filter.statuses.end()
+            && rating >= filter.min_rating && rating <= filter.max_rating
+            && document_id >= filter.min_document_id && document_id <= filter.max_document_id;
+    };
+    for (const string& query : GENERATED_QUERIES) {
+        const vector<Document> expected = server.FindTopDocuments(query, matches);
+        ASSERT_HINT(!expected.empty(), query);
+        ASSERT_HINT(AreSameDocuments(server.FindTopDocuments(query, filter), expected), query);
+        ASSERT_HINT(AreSameDocuments(server.FindTopDocuments(execution::par, query, filter), expected), query);
+    }
+    ASSERT(AreSameDocuments(server.FindTopDocuments("common"s, DocumentFilter{}), server.FindTopDocuments("common"s)));
+
+    // bounds are inclusive
+    filter.statuses = { DocumentStatus::BANNED };
+    filter.min_rating = 509;
+    filter.max_rating = 519;
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("common"s, filter)), (vector<int>{ 519, 509 }));
+    filter.min_document_id = 520;
+    ASSERT(server.FindTopDocuments("common"s, filter).empty());
+    // no status passes an empty list
+    ASSERT(server.FindTopDocuments("common"s, DocumentFilter{ {} }).empty());
+}
+
+void TestFilteredDocumentsAreNeverScored()
+{
+    SearchServer server("and"s);
+    AddGeneratedDocuments(server, 0, 1000);
+    DocumentFilter filter;
+    filter.min_document_id = 990;
+    // ids 990 to 998 pass, 999 is banned
+    const auto count_postings = [&server](const auto& find) {
+        const PruningStats before = server.GetPruningStats();
+        const vector<Document> documents = find();
+        const PruningStats after = server.GetPruningStats();
+        ASSERT_EQUAL(documents.size(), 5u);
+        return make_pair(after.scored_postings - before.scored_postings, after.skipped_postings - before.skipped_postings);
+    };
+    const pair<uint64_t, uint64_t> expected{ 9, 991 };
+    ASSERT(count_postings([&] { return server.FindTopDocuments("common"s, filter); }) == expected);
+    ASSERT(count_postings([&] { return server.FindTopDocuments(execution::par, "common"s, filter); }) == expected);
+    // a status is a filter too
+    ASSERT(count_postings([&] { return server.FindTopDocuments("common"s, DocumentStatus::BANNED); })
+        == make_pair(uint64_t{ 100 }, uint64_t{ 900 }));
+}
+
+void TestWordFrequencies()
+{
+    SearchServer server("and"s);
+    AddTestDocuments(server);
+    const map<string_view, double>& word_freqs = server.GetWordFrequencies(2);
+    ASSERT((word_freqs == map<string_view, double>{ { "cat"sv, 0.25 }, { "fluffy"sv, 0.5 }, { "tail"sv, 0.25 } }));
+    // the same map every time, until the document is removed
+    ASSERT(&server.GetWordFrequencies(2) == &word_freqs);
+    ASSERT(server.GetWordFrequencies(42).empty());
+    ASSERT_EQUAL(server.GetTermFrequencies(2).size(), 3u);
+    server.RemoveDocument(2);
+    ASSERT(server.GetWordFrequencies(2).empty());
+}
+
+void TestMaxScoreSkipsPostings()
+{
+    SearchServer server("and"s);
+    server.SetSegmentDocumentCount(100000);
+    for (int id = 0; id < 5000; ++id) {
+        const string text = id % 500 == 0 ? "rare rare rare common"s : "common word"s + to_string(id % 17);
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 7 });
+    }
+    const vector<string> queries = { "rare common"s, "rare word3 common"s, "common -rare"s };
+    vector<vector<Document>> expected;
+    for (const string& query : queries) {
+        expected.push_back(server.FindTopDocuments(query));
+    }
+
+    server.SetRetrievalStrategy(RetrievalStrategy::MAX_SCORE);
+    const PruningStats before = server.GetPruningStats();
+    for (size_t i = 0; i < queries.size(); ++i) {
+        ASSERT_HINT(AreSameDocuments(server.FindTopDocuments(queries[i]), expected[i]), queries[i]);
+    }
+    const PruningStats after = server.GetPruningStats();
+    ASSERT(after.scored_postings > before.scored_postings);
+    // the common word cannot lift a document above those with the rare one
+    ASSERT(after.skipped_postings - before.skipped_postings > 4000);
+}
+
+void TestPostingBlockBoundaries()
+{
+    for (const int document_count : { 127, 128, 129 }) {
+        SearchServer server("and"s);
+        for (int id = 0; id < document_count; ++id) {
+            const string text = id == 5 ? "word"s : id == 128 ? "word x y z"s : "word x"s;
+            server.AddDocument(id, text, DocumentStatus::ACTUAL, { 1 });
+        }
+        const string hint = to_string(document_count) + " postings"s;
+        const vector<PostingBlock> blocks = server.GetPostingBlocks("word"s);
+        ASSERT_EQUAL_HINT(blocks.size(), document_count == 129 ? 2u : 1u, hint);
+        ASSERT_EQUAL_HINT(blocks[0].last_ordinal, static_cast<DocumentOrdinal>(min(document_count, 128) - 1), hint);
+        ASSERT_EQUAL_HINT(blocks[0].max_term_freq, 1.0, hint);
+        if (document_count == 129) {
+            ASSERT_EQUAL(blocks[1].last_ordinal, 128u);
+            ASSERT_EQUAL(blocks[1].max_term_freq, 0.25);
+        }
+        ASSERT_HINT(server.GetPostingBlocks("x"s).size() == 1, hint);
+        ASSERT_HINT(server.GetPostingBlocks("missing"s).empty(), hint);
+    }
+
+    // blocks are rebuilt from the changed one on
+    PostingList postings;
+    for (DocumentOrdinal ordinal = 0; ordinal < 129; ++ordinal) {
+        postings.Add(ordinal, ordinal == 0 ? 1.0 : 0.5);
+    }
+    ASSERT_EQUAL(postings.GetBlocks().size(), 2u);
+    ASSERT(postings.Erase(0));
+    ASSERT_EQUAL(postings.GetBlocks().size(), 1u);
+    ASSERT_EQUAL(postings.GetBlocks()[0].last_ordinal, 128u);
+    ASSERT_EQUAL(postings.GetBlocks()[0].max_term_freq, 0.5);
+    ASSERT_EQUAL(postings.GetMaxTermFreq(), 0.5);
+}
+
+void TestSplitIntoWordsAtChunkBounds()
+{
+    // the plain definition: words split by spaces, the index of the first word with a control character
+    const auto split = [](const string& text) {
+        vector<string_view> words;
+        size_t first_invalid_word = string_view::npos;
+        size_t word_start = 0;
+        for (size_t i = 0; i <= text.size(); ++i) {
+            if (i == text.size() || text[i] == ' ') {
+                if (i > word_start) {
+                    words.push_back(string_view(text).substr(word_start, i - word_start));
+                }
+                word_start = i + 1;
+            }
+            else if (static_cast<unsigned char>(text[i]) < ' ' && first_invalid_word == string_view::npos) {
+                first_invalid_word = words.size();
+            }
+        }
+        return make_pair(words, first_invalid_word == string_view::npos ? words.size() : first_invalid_word);
+    };
+
+    // a separator or control character at every position around the ends of the first two 16-byte chunks
+    vector<string> texts;
+    for (size_t length : { 15u, 16u, 17u, 31u, 32u, 33u, 48u }) {
+        for (size_t position = 0; position < length; ++position) {
+            string text(length, 'a');
+            for (size_t i = 3; i < length; i += 7) {
+                text[i] = ' ';
+            }
+            for (const char c : { ' ', '\t', '\x01', '\x1F' }) {
+                text[position] = c;
+                texts.push_back(text);
+            }
+            text[position] = ' ';
+            if (position + 1 < length) {
+                text[position + 1] = ' ';
+                texts.push_back(text);
+            }
+        }
+    }
+    texts.push_back(string(16, ' ') + "word"s);
+    texts.push_back(string(15, 'a') + " "s + string(16, 'b'));
+    texts.push_back(string(32, 'a') + "\n"s);
+    texts.push_back("\x7F\x80 "s + string(14, '\xFF'));
+
+    vector<string_view> words;
+    for (const string& text : texts) {
+        const auto [expected_words, expected_invalid_word] = split(text);
+        const size_t first_invalid_word = SplitIntoWordsView(text, words);
+        ASSERT_HINT(words == expected_words, text);
+        ASSERT_EQUAL_HINT(first_invalid_word, expected_invalid_word, text);
+    }
+}
+
+void TestAddDocumentsIsAllOrNothing()
+{
+    SearchServer server("and"s);
+    server.SetSegmentDocumentCount(64);
+    AddGeneratedDocuments(server, 0, 100);
+    const vector<vector<Document>> expected = FindGeneratedQueries(server);
+
+    const auto add_bad_batch = [&server](const vector<DocumentInput>& documents, bool is_parallel) {
+        try {
+            if (is_parallel) {
+                server.AddDocuments(execution::par, documents);
+            }
+            else {
+                server.AddDocuments(documents);
+            }
+        }
+        catch (const invalid_argument&) {
+            return true;
+        }
+        return false;
+    };
+    const vector<vector<DocumentInput>> bad_batches = {
+        { { 200, "word1 fresh"s, DocumentStatus::ACTUAL, { 1 } }, { 200, "word2 fresh"s, DocumentStatus::ACTUAL, { 2 } } },
+        { { 201, "word1 fresh"s, DocumentStatus::ACTUAL, { 1 } }, { 42, "word2 fresh"s, DocumentStatus::ACTUAL, { 2 } } },
+        { { 202, "word1 fresh"s, DocumentStatus::ACTUAL, { 1 } }, { -1, "word2 fresh"s, DocumentStatus::ACTUAL, { 2 } } },
+        { { 203, "word1 fresh"s, DocumentStatus::ACTUAL, { 1 } }, { 204, "word2 fr\x12sh"s, DocumentStatus::ACTUAL, { 2 } } },
+    };
+    for (size_t i = 0; i < bad_batches.size(); ++i) {
+        for (const bool is_parallel : { false, true }) {
+            const string hint = "batch "s + to_string(i) + (is_parallel ? " par"s : " seq"s);
+            ASSERT_HINT(add_bad_batch(bad_batches[i], is_parallel), hint);
+            ASSERT_EQUAL_HINT(server.GetDocumentCount(), 100, hint);
+            ASSERT_HINT(AreSameResults(FindGeneratedQueries(server), expected), hint);
+            ASSERT_HINT(server.FindTopDocuments("fresh"s).empty(), hint);
+            ASSERT_HINT(server.GetWordFrequencies(201).empty(), hint);
+        }
+    }
+
+    // a good batch crossing segment bounds leaves the server as adding the documents one by one does
+    vector<string> texts;
+    for (int id = 100; id < 300; ++id) {
+        texts.push_back("word"s + to_string(id % 7) + " word"s + to_string(id % 11) + " word"s
+            + to_string(id % 13) + " common"s);
+    }
+    vector<DocumentInput> documents;
+    for (int id = 100; id < 300; ++id) {
+        documents.push_back({ id, texts[id - 100], id % 10 == 9 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id } });
+    }
+    SearchServer one_by_one("and"s);
+    one_by_one.SetSegmentDocumentCount(64);
+    AddGeneratedDocuments(one_by_one, 0, 300);
+    server.AddDocuments(execution::par, documents);
+    ASSERT_EQUAL(server.GetDocumentCount(), one_by_one.GetDocumentCount());
+    ASSERT(AreSameResults(FindGeneratedQueries(server), FindGeneratedQueries(one_by_one)));
+    ASSERT(vector<int>(server.begin(), server.end()) == vector<int>(one_by_one.begin(), one_by_one.end()));
+    for (const int id : { 0, 100, 163, 299 }) {
+        ASSERT_HINT(server.GetWordFrequencies(id) == one_by_one.GetWordFrequencies(id), to_string(id));
+    }
+}
+
+void TestRemoveDuplicates()
+{
+    SearchServer server("and with"s);
+    server.AddDocument(20, "curly hair"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+    // the same words as 2
+    server.AddDocument(3, "funny pet with curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+    // stop words differ
+    server.AddDocument(4, "funny pet and curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+    // repeated words
+    server.AddDocument(5, "funny funny pet and nasty nasty rat"s, DocumentStatus::ACTUAL, { 1, 2 });
+    server.AddDocument(6, "funny pet and not very nasty rat"s, DocumentStatus::ACTUAL, { 1, 2 });
+    // another order
+    server.AddDocument(7, "very nasty rat and not very funny pet"s, DocumentStatus::ACTUAL, { 1, 2 });
+    server.AddDocument(8, "pet with rat and rat and rat"s, DocumentStatus::ACTUAL, { 1, 2 });
+    server.AddDocument(9, "nasty rat with curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+    // added after 20, but has the lower id
+    server.AddDocument(11, "hair curly curly"s, DocumentStatus::BANNED, { 1 });
+
+    ostringstream output;
+    streambuf* const cout_buffer = cout.rdbuf(output.rdbuf());
+    RemoveDuplicates(server);
+    cout.rdbuf(cout_buffer);
+
+    ASSERT_EQUAL(output.str(), "Found duplicate document id 3\nFound duplicate document id 4\n"s
+        "Found duplicate document id 5\nFound duplicate document id 7\nFound duplicate document id 20\n"s);
+    ASSERT_EQUAL(vector<int>(server.begin(), server.end()), (vector<int>{ 1, 2, 6, 8, 9, 11 }));
+    ASSERT_EQUAL(server.GetDocumentCount(), 6);
+
+    // nothing left to remove
+    output.str(""s);
+    cout.rdbuf(output.rdbuf());
+    RemoveDuplicates(server);
+    cout.rdbuf(cout_buffer);
+    ASSERT(output.str().empty());
+    ASSERT_EQUAL(server.GetDocumentCount(), 6);
+}
+
+void TestMinHashEstimatesJaccardSimilarity()
+{
+    // documents i and i + 1000 share common_count of their 40 distinct words
+    SearchServer server("and"s);
+    server.SetMinHashSketches(true);
+    const auto make_text = [](int first_word, int word_count) {
+        string text;
+        for (int word = first_word; word < first_word + word_count; ++word) {
+            text += "w"s + to_string(word) + " "s;
+        }
+        return text;
+    };
+    for (const int common_count : { 0, 10, 20, 30, 40 }) {
+        const double similarity = common_count / (80.0 - common_count);
+        double error_sum = 0.0;
+        for (int pair = 0; pair < 50; ++pair) {
+            const int id = common_count * 100 + pair;
+            const int first_word = id * 100;
+            server.AddDocument(id, make_text(first_word, 40), DocumentStatus::ACTUAL, { 1 });
+            server.AddDocument(id + 10000, make_text(first_word + 40 - common_count, 40), DocumentStatus::ACTUAL, { 1 });
+            const double estimate = EstimateJaccardSimilarity(server.GetMinHashSketch(id), server.GetMinHashSketch(id + 10000));
+            // four standard errors
+            ASSERT_HINT(abs(estimate - similarity) <= 4 * 0.5 / sqrt(MIN_HASH_COUNT), to_string(id));
+            error_sum += estimate - similarity;
+        }
+        ASSERT_HINT(abs(error_sum / 50) < 0.05, to_string(common_count));
+    }
+    ASSERT(server.GetMinHashSketch(0) == ComputeMinHashSketch(server.GetTermFrequencies(0)));
+}
+
+void TestNearDuplicates()
+{
+    // 20 distinct words per document, a near duplicate changes one of them: 19 / 21 of the words are shared
+    SearchServer server("and"s);
+    const auto make_text = [](int first_word, int changed_word) {
+        string text;
+        for (int word = first_word; word < first_word + 20; ++word) {
+            text += "w"s + to_string(word == changed_word ? word + 1000000 : word) + " "s;
+        }
+        return text;
+    };
+    for (int id = 0; id < 200; ++id) {
+        server.AddDocument(id, make_text(id * 20, -1), DocumentStatus::ACTUAL, { 1 });
+    }
+    // a near duplicate of 3, two of 150 that are near duplicates of each other too, and a document sharing
+    // 16 of 24 words with 7
+    server.AddDocument(1000, make_text(60, 65), DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(500, make_text(3000, 3001), DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(501, make_text(3000, 3002), DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(502, make_text(144, -1), DocumentStatus::ACTUAL, { 1 });
+
+    const vector<NearDuplicate> near_duplicates = FindNearDuplicates(server);
+    ASSERT_EQUAL(near_duplicates.size(), 3u);
+    const vector<pair<int, int>> expected = { { 500, 150 }, { 501, 150 }, { 1000, 3 } };
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQUAL(near_duplicates[i].document_id, expected[i].first);
+        ASSERT_EQUAL(near_duplicates[i].original_id, expected[i].second);
+        ASSERT(abs(near_duplicates[i].similarity - 19.0 / 21.0) < MAX_DIFF);
+    }
+    // 502 is found only below its similarity of 2 / 3 with 7
+    ASSERT(FindNearDuplicates(server, 0.7).size() == 3u);
+    ASSERT(FindNearDuplicates(server, 0.6).size() == 4u);
+    server.SetMinHashSketches(true);
+    ASSERT(FindNearDuplicates(server, 0.6).size() == 4u);
+
+    ostringstream output;
+    streambuf* const cout_buffer = cout.rdbuf(output.rdbuf());
+    RemoveNearDuplicates(server);
+    cout.rdbuf(cout_buffer);
+    ASSERT_EQUAL(output.str(), "Found near duplicate document id 500 of document id 150\n"s
+        "Found near duplicate document id 501 of document id 150\nFound near duplicate document id 1000 of document id 3\n"s);
+    ASSERT_EQUAL(server.GetDocumentCount(), 201);
+    ASSERT(FindNearDuplicates(server).empty());
+}
+
+void TestThreadPoolStealsWork()
+{
+    ThreadPool pool(2);
+    // tasks submitted by a worker go to its own queue, while it waits for them only the other worker can run them
+    const bool is_stolen = pool.Submit([&pool] {
+        const thread::id owner = this_thread::get_id();
+        vector<future<thread::id>> tasks;
+        for (int i = 0; i < 8; ++i) {
+            tasks.push_back(pool.Submit([] { return this_thread::get_id(); }));
+        }
+        bool is_stolen = true;
+        for (future<thread::id>& task : tasks) {
+            is_stolen = is_stolen && task.wait_for(chrono::seconds(10)) == future_status::ready && task.get() != owner;
+        }
+        return is_stolen;
+    }).get();
+    ASSERT(is_stolen);
+    ASSERT_EQUAL(pool.GetWorkerCount(), 2u);
+}
+
+void TestThreadPoolPriorities()
+{
+    ThreadPool pool(1);
+    promise<void> gate;
+    shared_future<void> is_open = gate.get_future().share();
+    promise<void> started;
+    pool.Submit([is_open, &started] {
+        started.set_value();
+        is_open.wait();
+    });
+    // otherwise the caller could take the gate itself below
+    started.get_future().wait();
+
+    // the only worker is busy, it takes the high priority tasks first once it is free
+    mutex order_mutex;
+    vector<TaskPriority> order;
+    vector<future<void>> tasks;
+    for (const TaskPriority priority : { TaskPriority::LOW, TaskPriority::HIGH, TaskPriority::LOW, TaskPriority::HIGH }) {
+        tasks.push_back(pool.Submit([&order_mutex, &order, priority] {
+            lock_guard guard(order_mutex);
+            order.push_back(priority);
+        }, priority));
+    }
+
+    // a low priority ParallelFor runs a pending high priority task between its chunks
+    future<void> high_task;
+    pool.ParallelFor(100, [&pool, &high_task](size_t index) {
+        if (index == 0) {
+            high_task = pool.Submit([] {});
+        }
+    }, TaskPriority::LOW);
+    ASSERT(high_task.wait_for(chrono::seconds(0)) == future_status::ready);
+
+    gate.set_value();
+    for (future<void>& task : tasks) {
+        task.get();
+    }
+    ASSERT((order == vector<TaskPriority>{ TaskPriority::HIGH, TaskPriority::HIGH, TaskPriority::LOW, TaskPriority::LOW }));
+}
+
+void TestThreadPoolParallelFor()
+{
+    ThreadPool pool(3);
+    vector<atomic<int>> calls(1000);
+    pool.ParallelFor(calls.size(), [&pool, &calls](size_t index) {
+        ++calls[index];
+        // the pool may be used again from inside
+        pool.ParallelFor(index % 3, [](size_t) {});
+    });
+    ASSERT(all_of(calls.begin(), calls.end(), [](const atomic<int>& count) { return count.load() == 1; }));
+
+    // the exception comes out once all other calls are done
+    atomic<int> call_count = 0;
+    bool is_thrown = false;
+    try {
+        pool.ParallelFor(100, [&call_count](size_t index) {
+            if (index == 57) {
+                throw runtime_error("57"s);
+            }
+            ++call_count;
+        });
+    }
+    catch (const runtime_error& error) {
+        is_thrown = error.what() == "57"s;
+    }
+    ASSERT(is_thrown);
+    ASSERT_EQUAL(call_count.load(), 99);
+    ASSERT_EQUAL(pool.Submit([] { return 42; }, TaskPriority::LOW).get(), 42);
+
+    vector<int> values(500);
+    ForEach(pool, values.begin(), values.end(), [](int& value) { value = 1; });
+    ASSERT_EQUAL(accumulate(values.begin(), values.end(), 0), 500);
+}
+
+void TestSearchServerOnThreadPool()
+{
+    SearchServer expected("and"s);
+    AddGeneratedDocuments(expected, 0, 600);
+
+    // the pool runs parallel calls and merges of the server, or stands in for an execution policy
+    const auto pool = make_shared<ThreadPool>(2);
+    SearchServer server("and"s);
+    server.SetThreadPool(pool);
+    ASSERT(server.GetThreadPool() == pool);
+    server.SetSegmentDocumentCount(64);
+    vector<string> texts;
+    for (int id = 0; id < 600; ++id) {
+        texts.push_back("word"s + to_string(id % 7) + " word"s + to_string(id % 11) + " word"s
+            + to_string(id % 13) + " common"s);
+    }
+    vector<DocumentInput> documents;
+    for (int id = 0; id < 600; ++id) {
+        documents.push_back({ id, texts[id], id % 10 == 9 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id } });
+    }
+    server.AddDocuments(execution::par, vector<DocumentInput>(documents.begin(), documents.begin() + 300));
+    server.AddDocuments(*pool, vector<DocumentInput>(documents.begin() + 300, documents.end()));
+    server.WaitForMerges();
+    ASSERT_EQUAL(server.GetDocumentCount(), 600);
+    for (const string& query : GENERATED_QUERIES) {
+        ASSERT_HINT(AreSameDocuments(server.FindTopDocuments(execution::par, query), expected.FindTopDocuments(query)), query);
+        ASSERT_HINT(AreSameDocuments(server.FindTopDocuments(*pool, query), expected.FindTopDocuments(query)), query);
+        ASSERT_HINT(AreSameDocuments(expected.FindTopDocuments(*pool, query, DocumentStatus::BANNED),
+            expected.FindTopDocuments(query, DocumentStatus::BANNED)), query);
+    }
+
+    server.SetThreadPool(nullptr);
+    ASSERT(!server.GetThreadPool());
+    ASSERT(AreSameResults(FindGeneratedQueries(server), FindGeneratedQueries(expected)));
+}
+
+void TestMatchDocument()
+{
+    SearchServer server("and"s);
+    AddTestDocuments(server);
+    const auto [words, status] = server.MatchDocument("fluffy cat collar"s, 2);
+    ASSERT_EQUAL(words.size(), 2u);
+    ASSERT_EQUAL(words[0], "cat"s);
+    ASSERT_EQUAL(words[1], "fluffy"s);
+    ASSERT(status == DocumentStatus::ACTUAL);
+    ASSERT(get<0>(server.MatchDocument("fluffy -tail"s, 2)).empty());
+
+    const auto [banned_words, banned_status] = server.MatchDocument(execution::par, "starling eugene"s, 4);
+    ASSERT_EQUAL(banned_words.size(), 2u);
+    ASSERT(banned_status == DocumentStatus::BANNED);
+}
+
+void TestMatchDocumentIntoBuffer()
+{
+    SearchServer server("and"s);
+    AddGeneratedDocuments(server, 100, 100);
+    AddTestDocuments(server);
+
+    // every call replaces the words of the previous one
+    vector<string_view> matched_words;
+    for (const string& query : { "word1 word2 common"s, "word3 -word5"s, "common -word0 word12"s, "missing"s }) {
+        for (int id = 100; id < 200; ++id) {
+            const auto [expected_words, expected_status] = server.MatchDocument(query, id);
+            ASSERT(server.MatchDocument(query, id, matched_words) == expected_status);
+            ASSERT_HINT(matched_words == expected_words, query + " in "s + to_string(id));
+        }
+    }
+
+    ASSERT(server.MatchDocument("starling eugene groomed"s, 4, matched_words) == DocumentStatus::BANNED);
+    ASSERT((matched_words == vector<string_view>{ "eugene"sv, "groomed"sv, "starling"sv }));
+    ASSERT(server.MatchDocument("starling -eugene"s, 4, matched_words) == DocumentStatus::BANNED);
+    ASSERT(matched_words.empty());
+}
+
+void TestRemoveDocument()
+{
+    SearchServer server("and"s);
+    AddTestDocuments(server);
+    server.RemoveDocument(2);
+    ASSERT_EQUAL(server.GetDocumentCount(), 3);
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("fluffy cat"s)), vector<int>{ 1 });
+    ASSERT(server.GetWordFrequencies(2).empty());
+    ASSERT_EQUAL(vector<int>(server.begin(), server.end()), (vector<int>{ 1, 3, 4 }));
+
+    // unknown and removed ids throw as the .at of the original server did
+    for (const int document_id : { 2, 5, -1 }) {
+        bool is_thrown = false;
+        try {
+            server.RemoveDocument(document_id);
+        }
+        catch (const out_of_range&) {
+            is_thrown = true;
+        }
+        ASSERT_HINT(is_thrown, to_string(document_id));
+        is_thrown = false;
+        try {
+            server.RemoveDocument(execution::par, document_id);
+        }
+        catch (const out_of_range&) {
+            is_thrown = true;
+        }
+        ASSERT_HINT(is_thrown, to_string(document_id));
+    }
+    ASSERT_EQUAL(server.GetDocumentCount(), 3);
+}
+
+void TestRemoveDocuments()
+{
+    SearchServer server("and"s);
+    server.SetSegmentDocumentCount(64);
+    AddGeneratedDocuments(server, 0, 300);
+    SearchServer one_by_one("and"s);
+    one_by_one.SetSegmentDocumentCount(64);
+    AddGeneratedDocuments(one_by_one, 0, 300);
+
+    vector<int> document_ids;
+    for (int id = 0; id < 300; id += 3) {
+        document_ids.push_back(id);
+        one_by_one.RemoveDocument(id);
+    }
+    document_ids.push_back(0);
+    server.RemoveDocuments(document_ids);
+    ASSERT_EQUAL(server.GetDocumentCount(), 200);
+    ASSERT(AreSameResults(FindGeneratedQueries(server), FindGeneratedQueries(one_by_one)));
+    ASSERT(vector<int>(server.begin(), server.end()) == vector<int>(one_by_one.begin(), one_by_one.end()));
+
+    // a batch with an unknown id removes nothing
+    bool is_thrown = false;
+    try {
+        server.RemoveDocuments({ 1, 2, 3 });
+    }
+    catch (const out_of_range&) {
+        is_thrown = true;
+    }
+    ASSERT(is_thrown);
+    ASSERT_EQUAL(server.GetDocumentCount(), 200);
+    ASSERT(AreSameResults(FindGeneratedQueries(server), FindGeneratedQueries(one_by_one)));
+    server.RemoveDocuments({});
+    ASSERT_EQUAL(server.GetDocumentCount(), 200);
+}
+
+void TestRemovedDocumentsTriggerRewrite()
+{
+    SearchServer server("and"s);
+    server.SetSegmentDocumentCount(256);
+    AddGeneratedDocuments(server, 0, 600);
+    ASSERT_EQUAL(server.GetSegmentCount(), 3u);
+    ASSERT_EQUAL(server.GetPostingBlocks("common"s).size(), 5u);
+
+    // the first segment keeps its tombstones while they are at most half of it
+    vector<int> document_ids(128);
+    iota(document_ids.begin(), document_ids.end(), 0);
+    server.RemoveDocuments(document_ids);
+    server.WaitForMerges();
+    ASSERT_EQUAL(server.GetPostingBlocks("common"s).size(), 5u);
+
+    // and is rewritten alone once they are more
+    server.RemoveDocument(128);
+    server.WaitForMerges();
+    ASSERT_EQUAL(server.GetSegmentCount(), 3u);
+    ASSERT_EQUAL(server.GetPostingBlocks("common"s).size(), 4u);
+    ASSERT_EQUAL(server.GetPostingBlocks("common"s)[0].last_ordinal, 255u);
+
+    SearchServer live_only("and"s);
+    AddGeneratedDocuments(live_only, 129, 471);
+    ASSERT(AreSameResults(FindGeneratedQueries(server), FindGeneratedQueries(live_only)));
+}
+
+void TestInvalidInput()
+{
+    SearchServer server("and"s);
+    AddTestDocuments(server);
+    bool is_thrown = false;
+    try {
+        server.AddDocument(1, "duplicate id"s, DocumentStatus::ACTUAL, {});
+    }
+    catch (const invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT_HINT(is_thrown, "Adding a document with an existing id must throw"s);
+    is_thrown = false;
+    try {
+        server.FindTopDocuments("cat --collar"s);
+    }
+    catch (const invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT_HINT(is_thrown, "A double minus must throw"s);
+}
+
+void TestSearchServer()
+{
+    RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);
+    RUN_TEST(TestMinusWordsExcludeDocuments);
+    RUN_TEST(TestRelevanceAndRating);
+    RUN_TEST(TestTopDocumentSelection);
+    RUN_TEST(TestStatusAndPredicate);
+    RUN_TEST(TestPostingListMatchesMapLayout);
+    RUN_TEST(TestScoreAccumulatorReuse);
+    RUN_TEST(TestParallelScoringMatchesSequential);
+    RUN_TEST(TestScoringSkipsRemovedDocumentsInEverySegment);
+    RUN_TEST(TestCompressedPostings);
+    RUN_TEST(TestCompressedPostingCursor);
+    RUN_TEST(TestSnapshotRoundTrip);
+    RUN_TEST(TestSegmentMerges);
+    RUN_TEST(TestBatchOrdersTiesLikeFindTopDocuments);
+    RUN_TEST(TestConcurrentLruCache);
+    RUN_TEST(TestQueryCacheInvalidation);
+    RUN_TEST(TestPhraseQueries);
+    RUN_TEST(TestQuotesWithoutWordPositions);
+    RUN_TEST(TestPrefixQueries);
+    RUN_TEST(TestTypoTolerance);
+    RUN_TEST(TestTermDictionaryRuns);
+    RUN_TEST(TestBm25Scoring);
+    RUN_TEST(TestDocumentFilter);
+    RUN_TEST(TestFilteredDocumentsAreNeverScored);
+    RUN_TEST(TestWordFrequencies);
+    RUN_TEST(TestMaxScoreSkipsPostings);
+    RUN_TEST(TestPostingBlockBoundaries);
+    RUN_TEST(TestSplitIntoWordsAtChunkBounds);
+    RUN_TEST(TestAddDocumentsIsAllOrNothing);
+    RUN_TEST(TestRemoveDuplicates);
+    RUN_TEST(TestMinHashEstimatesJaccardSimilarity);
+    RUN_TEST(TestNearDuplicates);
+    RUN_TEST(TestThreadPoolStealsWork);
+    RUN_TEST(TestThreadPoolPriorities);
+    RUN_TEST(TestThreadPoolParallelFor);
+    RUN_TEST(TestSearchServerOnThreadPool);
+    RUN_TEST(TestMatchDocument);
+    RUN_TEST(TestMatchDocumentIntoBuffer);
+    RUN_TEST(TestRemoveDocument);
+    RUN_TEST(TestRemoveDocuments);
+    RUN_TEST(TestRemovedDocumentsTriggerRewrite);
+    RUN_TEST(TestInvalidInput);
+}
@@ -0,0 +1,6 @@
+#include "test_example_functions.h"
+
+int main()
+{
+    TestSearchServer();
+}
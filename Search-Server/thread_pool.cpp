@@ -0,0 +1,184 @@
+#include "thread_pool.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+    // pool and queue of the worker running on this thread, external threads have none
+    thread_local const ThreadPool* current_pool = nullptr;
+    thread_local size_t current_queue = 0;
+
+    void PinThread(thread& worker, size_t core)
+    {
+#ifdef _WIN32
+        SetThreadAffinityMask(worker.native_handle(), DWORD_PTR(1) << (core % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+        cpu_set_t cores;
+        CPU_ZERO(&cores);
+        CPU_SET(core % CPU_SETSIZE, &cores);
+        pthread_setaffinity_np(worker.native_handle(), sizeof(cores), &cores);
+#else
+        (void)worker;
+        (void)core;
+#endif
+    }
+}
+
+ThreadPool::ThreadPool(size_t worker_count, bool pin_workers)
+{
+    worker_count = max<size_t>(worker_count, 1);
+    for (size_t i = 0; i < worker_count; ++i)
+    {
+        queues_.push_back(make_unique<TaskQueue>());
+    }
+    const size_t core_count = max(1u, thread::hardware_concurrency());
+    for (size_t i = 0; i < worker_count; ++i)
+    {
+        workers_.emplace_back([this, i]() { RunWorker(i); });
+        if (pin_workers)
+        {
+            PinThread(workers_.back(), i % core_count);
+        }
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard lock(sleep_mutex_);
+        is_stopping_ = true;
+    }
+    wake_.notify_all();
+    for (thread& worker : workers_)
+    {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::GetWorkerCount() const
+{
+    return workers_.size();
+}
+
+// a worker pushes to its own queue, other threads spread their tasks over all queues
+void ThreadPool::Push(Task task, TaskPriority priority)
+{
+    // counted before the task becomes visible, so that a thief never takes an uncounted task
+    if (priority == TaskPriority::HIGH)
+    {
+        ++pending_high_priority_tasks_;
+    }
+    {
+        lock_guard lock(sleep_mutex_);
+        ++pending_tasks_;
+    }
+    const size_t queue = current_pool == this ? current_queue : next_queue_++ % queues_.size();
+    {
+        lock_guard guard(queues_[queue]->mutex);
+        queues_[queue]->tasks[static_cast<size_t>(priority)].push_back(move(task));
+    }
+    wake_.notify_one();
+}
+
+bool ThreadPool::TryRunTask(TaskPriority priority)
+{
+    const size_t own_queue = current_pool == this ? current_queue : 0;
+    Task task;
+    for (size_t i = 0; i < queues_.size() && !task; ++i)
+    {
+        TaskQueue& queue = *queues_[(own_queue + i) % queues_.size()];
+        lock_guard guard(queue.mutex);
+        deque<Task>& tasks = queue.tasks[static_cast<size_t>(priority)];
+        if (tasks.empty())
+        {
+            continue;
+        }
+        // the newest task of the own queue is the most likely to find its data in the cache
+        if (i == 0)
+        {
+            task = move(tasks.back());
+            tasks.pop_back();
+        }
+        else
+        {
+            task = move(tasks.front());
+            tasks.pop_front();
+        }
+    }
+    if (!task)
+    {
+        return false;
+    }
+    --pending_tasks_;
+    if (priority == TaskPriority::HIGH)
+    {
+        --pending_high_priority_tasks_;
+    }
+    task();
+    return true;
+}
+
+void ThreadPool::RunChunks(ParallelForState& state, TaskPriority priority)
+{
+    while (true)
+    {
+        const size_t first = state.next_index.fetch_add(state.chunk_size);
+        if (first >= state.count)
+        {
+            return;
+        }
+        const size_t last = min(first + state.chunk_size, state.count);
+        // a throwing call does not skip the rest of its chunk
+        for (size_t index = first; index < last; ++index)
+        {
+            try
+            {
+                state.function(index);
+            }
+            catch (...)
+            {
+                lock_guard lock(state.mutex);
+                if (!state.error)
+                {
+                    state.error = current_exception();
+                }
+            }
+        }
+        if (state.done_count.fetch_add(last - first) + (last - first) == state.count)
+        {
+            lock_guard lock(state.mutex);
+            state.done.notify_all();
+        }
+
+        while (priority == TaskPriority::LOW && pending_high_priority_tasks_.load() > 0
+            && TryRunTask(TaskPriority::HIGH))
+        {
+        }
+    }
+}
+
+void ThreadPool::RunWorker(size_t worker)
+{
+    current_pool = this;
+    current_queue = worker;
+    while (true)
+    {
+        if (TryRunTask(TaskPriority::HIGH) || TryRunTask(TaskPriority::LOW))
+        {
+            continue;
+        }
+        unique_lock lock(sleep_mutex_);
+        wake_.wait(lock, [this]() { return is_stopping_ || pending_tasks_.load() > 0; });
+        if (is_stopping_ && pending_tasks_.load() == 0)
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <execution>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+enum class TaskPriority
+{
+    HIGH,
+    LOW,
+};
+
+// Work-stealing pool: every worker takes tasks from the back of its own queues and, when they are empty,
+// steals from the front of the queues of the others. High priority tasks of any worker are taken before
+// low priority ones, and a long low priority ParallelFor lets pending high priority tasks run between its chunks
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t worker_count = std::thread::hardware_concurrency(), bool pin_workers = false);
+
+    ThreadPool(const ThreadPool&) = delete;
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // runs every task already submitted before the workers stop
+    ~ThreadPool();
+
+    size_t GetWorkerCount() const;
+
+    template <typename Function>
+    auto Submit(Function function, TaskPriority priority = TaskPriority::HIGH) -> std::future<decltype(function())>;
+
+    // Calls function(i) for every i in [0, count) and returns once all calls are done, rethrowing the first
+    // exception thrown by one of them, the other calls run all the same. The calling thread takes part in the work, so function may use the pool again
+    template <typename Function>
+    void ParallelFor(size_t count, Function function, TaskPriority priority = TaskPriority::HIGH);
+
+private:
+    using Task = std::function<void()>;
+
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks[2];
+    };
+
+    struct ParallelForState {
+        std::atomic<size_t> next_index = 0;
+        std::atomic<size_t> done_count = 0;
+        size_t count = 0;
+        size_t chunk_size = 1;
+        std::function<void(size_t)> function;
+        std::mutex mutex;
+        std::condition_variable done;
+        std::exception_ptr error;
+    };
+
+    void Push(Task task, TaskPriority priority);
+
+    // a task of the given priority from the queue of the current worker or stolen from another one
+    bool TryRunTask(TaskPriority priority);
+
+    void RunChunks(ParallelForState& state, TaskPriority priority);
+
+    void RunWorker(size_t worker);
+
+    std::vector<std::unique_ptr<TaskQueue>> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> next_queue_ = 0;
+    std::atomic<size_t> pending_tasks_ = 0;
+    std::atomic<size_t> pending_high_priority_tasks_ = 0;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool is_stopping_ = false;
+};
+
+template <typename Function>
+auto ThreadPool::Submit(Function function, TaskPriority priority) -> std::future<decltype(function())>
+{
+    // std::function needs a copyable target
+    auto task = std::make_shared<std::packaged_task<decltype(function())()>>(std::move(function));
+    auto result = task->get_future();
+    Push([task]() { (*task)(); }, priority);
+    return result;
+}
+
+template <typename Function>
+void ThreadPool::ParallelFor(size_t count, Function function, TaskPriority priority)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    // helper tasks may start after the call has returned, so everything they touch is shared
+    auto state = std::make_shared<ParallelForState>();
+    state->count = count;
+    state->chunk_size = std::max<size_t>(1, count / (4 * (workers_.size() + 1)));
+    state->function = [&function](size_t index) { function(index); };
+
+    const size_t helper_count = std::min(workers_.size(), (count + state->chunk_size - 1) / state->chunk_size - 1);
+    for (size_t i = 0; i < helper_count; ++i)
+    {
+        Push([this, state, priority]() { RunChunks(*state, priority); }, priority);
+    }
+    RunChunks(*state, priority);
+
+    std::unique_lock lock(state->mutex);
+    state->done.wait(lock, [&state]() { return state->done_count.load() == state->count; });
+    if (state->error)
+    {
+        std::rethrow_exception(state->error);
+    }
+}
+
+// std::execution::par and par_unseq, the standard policies a ThreadPool can stand in for
+template <typename ExecutionPolicy>
+constexpr bool IsParallelPolicy()
+{
+    using Policy = std::decay_t<ExecutionPolicy>;
+    return std::is_same_v<Policy, std::execution::parallel_policy>
+        || std::is_same_v<Policy, std::execution::parallel_unsequenced_policy>;
+}
+
+// std::for_each with a standard execution policy, or the same calls spread over a ThreadPool
+template <typename ExecutionPolicy, typename Iterator, typename Function>
+void ForEach(ExecutionPolicy&& policy, Iterator first, Iterator last, Function function,
+    TaskPriority priority = TaskPriority::HIGH)
+{
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, ThreadPool>)
+    {
+        policy.ParallelFor(static_cast<size_t>(last - first), [&](size_t index) { function(first[index]); }, priority);
+    }
+    else
+    {
+        std::for_each(policy, first, last, function);
+    }
+}